@@ -1,34 +1,37 @@
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <math.h>
 #include <time.h>
 
-#define DEVICE_PATH "/dev/vled"
-#define SYSFS_STATE "/sys/class/vled/vled/led_state"
-#define SYSFS_BRIGHTNESS "/sys/class/vled/vled/brightness"
-#define SYSFS_COLOR "/sys/class/vled/vled/color"
+#include "libvled.h"
+#include "vled_core.h"
+
+#define DEVICE_PATH "/dev/vled0"
 
 // Глобальные переменные для состояния светодиода
 typedef struct {
     gboolean led_state;
     gint brightness;
     gchar color[20];
-    cairo_surface_t *led_on_surface;
-    cairo_surface_t *led_off_surface;
+    guint32 rgb;                // Цвет 0x00RRGGBB, соответствует color
 } LedState;
 
 static LedState led_state = {
     .led_state = FALSE,
     .brightness = 128,
     .color = "green",
-    .led_on_surface = NULL,
-    .led_off_surface = NULL
+    .rgb = 0x00ff00,
 };
 
+// Соединение с драйвером, открывается один раз при запуске
+static struct vled *led = NULL;
+
 // Глобальные виджеты
 static GtkWidget *led_indicator = NULL;
 static GtkWidget *brightness_scale = NULL;
@@ -37,123 +40,122 @@ static GtkWidget *status_label = NULL;
 static GtkWidget *log_textview = NULL;
 static GtkTextBuffer *log_buffer = NULL;
 static GtkWidget *toggle_button = NULL;
+static GtkWidget *live_sync_check = NULL;
+
+// Логирование в графическом интерфейсе. Сообщения копятся в log_pending и
+// добавляются в буфер одной вставкой из tick-обработчика журнала, то есть
+// раз в кадр перед его отрисовкой; там же удаляются строки сверх
+// log_max_lines и выполняется одна прокрутка. Так размер лога не растет при
+// долгой работе, а вставки не зависят от загрузки главного цикла.
+#define LOG_DEFAULT_LINES 1000
+
+static guint log_max_lines = LOG_DEFAULT_LINES;    // --log-lines N
+static GString *log_pending = NULL;
+static guint log_pending_lines = 0;
+static guint log_flush_id = 0;     // Tick-обработчик log_textview
+static GtkTextMark *log_end_mark = NULL;
+
+static gboolean gui_log_flush(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    GtkTextIter start, end;
+    
+    log_flush_id = 0;
+    if (!log_pending_lines)
+        return G_SOURCE_REMOVE;
+    
+    gtk_text_buffer_get_end_iter(log_buffer, &end);
+    gtk_text_buffer_insert(log_buffer, &end, log_pending->str, log_pending->len);
+    g_string_truncate(log_pending, 0);
+    log_pending_lines = 0;
+    
+    // Последняя строка буфера пустая - после завершающего '\n'
+    gint excess = gtk_text_buffer_get_line_count(log_buffer) - 1 - (gint)log_max_lines;
+    if (excess > 0) {
+        gtk_text_buffer_get_start_iter(log_buffer, &start);
+        gtk_text_buffer_get_iter_at_line(log_buffer, &end, excess);
+        gtk_text_buffer_delete(log_buffer, &start, &end);
+    }
+    
+    // Автопрокрутка к последнему сообщению
+    gtk_text_buffer_get_end_iter(log_buffer, &end);
+    if (!log_end_mark)
+        log_end_mark = gtk_text_buffer_create_mark(log_buffer, "log-end", &end, FALSE);
+    gtk_text_buffer_move_mark(log_buffer, log_end_mark, &end);
+    gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(log_textview), log_end_mark);
+    
+    return G_SOURCE_REMOVE;
+}
 
-// Логирование в графическом интерфейсе
 static void gui_log(const char *message)
 {
     if (!log_buffer) return;
     
-    GtkTextIter end;
     time_t now = time(NULL);
     struct tm *tm_info = localtime(&now);
     char timestamp[20];
     strftime(timestamp, sizeof(timestamp), "%H:%M:%S", tm_info);
     
-    char *log_message = g_strdup_printf("[%s] %s\n", timestamp, message);
-    
-    gtk_text_buffer_get_end_iter(log_buffer, &end);
-    gtk_text_buffer_insert(log_buffer, &end, log_message, -1);
+    if (!log_pending)
+        log_pending = g_string_sized_new(4096);
+    g_string_append_printf(log_pending, "[%s] %s\n", timestamp, message);
     
-    // Автопрокрутка к новому сообщению
-    GtkTextMark *mark = gtk_text_buffer_create_mark(log_buffer, "end", &end, FALSE);
-    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(log_textview), mark, 0.0, FALSE, 0.0, 0.0);
-    gtk_text_buffer_delete_mark(log_buffer, mark);
+    // Сообщения, которые все равно будут удалены при вставке, не копятся
+    if (++log_pending_lines > log_max_lines) {
+        const char *eol = strchr(log_pending->str, '\n');
+        g_string_erase(log_pending, 0, eol - log_pending->str + 1);
+        log_pending_lines--;
+    }
     
-    g_free(log_message);
+    if (!log_flush_id && log_textview)
+        log_flush_id = gtk_widget_add_tick_callback(log_textview, gui_log_flush, NULL, NULL);
 }
 
 // Функции для работы с драйвером
-static void write_to_device(const char *command)
+static void write_to_device(__u32 mask)
 {
-    int fd = open(DEVICE_PATH, O_WRONLY);
-    if (fd < 0) {
-        char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg), "Failed to open device: %s", strerror(errno));
-        gui_log(error_msg);
+    struct vled_state st = {
+        .mask = mask,
+        .led_state = led_state.led_state ? 1 : 0,
+        .brightness = led_state.brightness,
+    };
+    strncpy(st.color, led_state.color, sizeof(st.color) - 1);
+    
+    if (!led) {
+        gui_log("Device is not open");
         return;
     }
     
-    ssize_t bytes_written = write(fd, command, strlen(command));
-    if (bytes_written < 0) {
+    int retval = vled_set_state(led, &st);
+    if (retval < 0) {
         char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg), "Write failed: %s", strerror(errno));
+        snprintf(error_msg, sizeof(error_msg), "ioctl failed: %s", strerror(-retval));
         gui_log(error_msg);
     } else {
         char log_msg[100];
-        snprintf(log_msg, sizeof(log_msg), "Sent command: %s", command);
+        snprintf(log_msg, sizeof(log_msg), "Sent state: %s, brightness %u, color %s (mask 0x%x)",
+                 st.led_state ? "ON" : "OFF", st.brightness, st.color, mask);
         gui_log(log_msg);
     }
-    
-    close(fd);
 }
 
-static void write_to_sysfs(const char *path, const char *value)
+// Создание изображения светодиода размером size x size. Рисунок задан
+// в координатах 200x200 и масштабируется при построении, а не при выводе.
+// Глобальное состояние не используется: функция вызывается и из потока
+// предварительной отрисовки.
+static cairo_surface_t* create_led_surface(gboolean on, guint32 rgb, gint brightness, int size)
 {
-    FILE *fp = fopen(path, "w");
-    if (fp) {
-        fprintf(fp, "%s", value);
-        fclose(fp);
-        char log_msg[100];
-        snprintf(log_msg, sizeof(log_msg), "Sysfs write: %s = %s", path, value);
-        gui_log(log_msg);
-    } else {
-        char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg), "Failed to open %s: %s", path, strerror(errno));
-        gui_log(error_msg);
-    }
-}
-
-static gboolean read_from_sysfs(const char *path, char *buffer, size_t size)
-{
-    FILE *fp = fopen(path, "r");
-    if (fp) {
-        if (fgets(buffer, size, fp) == NULL) {
-            strcpy(buffer, "Error");
-            fclose(fp);
-            return FALSE;
-        }
-        fclose(fp);
-        
-        // Удаляем символ новой строки
-        buffer[strcspn(buffer, "\n")] = 0;
-        return TRUE;
-    } else {
-        char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg), "Failed to read %s: %s", path, strerror(errno));
-        gui_log(error_msg);
-        return FALSE;
-    }
-}
-
-// Создание изображения светодиода
-static cairo_surface_t* create_led_surface(gboolean on, const char *color_name)
-{
-    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 200, 200);
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
     cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, size / 200.0, size / 200.0);
     
-    // Цвета в зависимости от выбранного цвета
-    double r, g, b;
-    
-    if (strcmp(color_name, "red") == 0) {
-        r = 1.0; g = 0.2; b = 0.2;
-    } else if (strcmp(color_name, "green") == 0) {
-        r = 0.2; g = 1.0; b = 0.2;
-    } else if (strcmp(color_name, "blue") == 0) {
-        r = 0.2; g = 0.2; b = 1.0;
-    } else if (strcmp(color_name, "yellow") == 0) {
-        r = 1.0; g = 1.0; b = 0.2;
-    } else if (strcmp(color_name, "white") == 0) {
-        r = 1.0; g = 1.0; b = 1.0;
-    } else if (strcmp(color_name, "cyan") == 0) {
-        r = 0.2; g = 1.0; b = 1.0;
-    } else if (strcmp(color_name, "magenta") == 0) {
-        r = 1.0; g = 0.2; b = 1.0;
-    } else {
-        r = 0.2; g = 1.0; b = 0.2; // По умолчанию зеленый
-    }
+    // Каналы RGB драйвера, приподнятые до 0.2, чтобы погашенный канал
+    // не делал светодиод черным
+    double r = 0.2 + 0.8 * ((rgb >> 16) & 0xff) / 255.0;
+    double g = 0.2 + 0.8 * ((rgb >> 8) & 0xff) / 255.0;
+    double b = 0.2 + 0.8 * (rgb & 0xff) / 255.0;
     
     // Регулировка яркости
-    double brightness_factor = led_state.brightness / 255.0;
+    double brightness_factor = brightness / 255.0;
     if (!on) {
         brightness_factor *= 0.3; // Для выключенного состояния
     }
@@ -240,19 +242,209 @@ static cairo_surface_t* create_led_surface(gboolean on, const char *color_name)
     return surface;
 }
 
-// Обновление изображения светодиода
-static void update_led_image(void)
+// Кэш готовых изображений светодиода с вытеснением давно не использованных.
+// Ключ - (вкл/выкл, цвет, уровень яркости, размер). Яркость квантуется до
+// LED_CACHE_LEVELS уровней: при движении ползунка соседние значения дают
+// одно изображение. Выключенный светодиод от цвета и яркости не зависит.
+// Размер кэша ограничен и числом записей, и суммарным объемом изображений:
+// одно изображение 1200x1200 (600x600 при масштабе 2) занимает ~5.5 МБ.
+#define LED_CACHE_SIZE      96
+#define LED_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define LED_CACHE_LEVELS    32
+
+typedef struct {
+    cairo_surface_t *surface;   // NULL - запись свободна
+    gboolean on;
+    guint32 rgb;
+    gint level;
+    gint size;
+    gsize bytes;
+    guint64 last_used;
+} LedCacheEntry;
+
+// Уровень яркости и обратно; обратное преобразование округляет вверх,
+// чтобы яркость уровня снова давала тот же уровень
+static gint led_brightness_level(gint brightness)
+{
+    return CLAMP(brightness, 0, 255) * (LED_CACHE_LEVELS - 1) / 255;
+}
+
+static gint led_level_brightness(gint level)
+{
+    return (level * 255 + LED_CACHE_LEVELS - 2) / (LED_CACHE_LEVELS - 1);
+}
+
+static LedCacheEntry led_cache[LED_CACHE_SIZE];
+static guint64 led_cache_clock = 0;
+static guint64 led_cache_misses = 0;
+static gsize led_cache_bytes = 0;
+static GMutex led_cache_lock;   // Кэш заполняется и потоком предварительной отрисовки
+
+static void led_cache_key(gboolean on, guint32 *rgb, gint *level, gint brightness)
+{
+    if (!on) {
+        *rgb = 0;
+        *level = 0;
+    } else {
+        *level = led_brightness_level(brightness);
+    }
+}
+
+// Поиск записи, вызывается под led_cache_lock
+static LedCacheEntry *led_cache_find(gboolean on, guint32 rgb, gint level, gint size)
+{
+    for (int i = 0; i < LED_CACHE_SIZE; i++) {
+        LedCacheEntry *e = &led_cache[i];
+        if (e->surface && e->on == on && e->rgb == rgb && e->level == level && e->size == size)
+            return e;
+    }
+    return NULL;
+}
+
+// Объем изображения в байтах
+static gsize led_surface_bytes(cairo_surface_t *surface)
+{
+    return (gsize)cairo_image_surface_get_stride(surface) *
+           cairo_image_surface_get_height(surface);
+}
+
+// Освобождение записи, вызывается под led_cache_lock
+static void led_cache_evict(LedCacheEntry *e)
+{
+    cairo_surface_destroy(e->surface);
+    e->surface = NULL;
+    led_cache_bytes -= e->bytes;
+}
+
+// Запись с наименьшим last_used, или свободная, если free_ok.
+// NULL, если подходящих записей нет. Вызывается под led_cache_lock.
+static LedCacheEntry *led_cache_lru(gboolean free_ok)
+{
+    LedCacheEntry *lru = NULL;
+    
+    for (int i = 0; i < LED_CACHE_SIZE; i++) {
+        LedCacheEntry *e = &led_cache[i];
+        if (!e->surface) {
+            if (free_ok)
+                return e;
+            continue;
+        }
+        if (!lru || e->last_used < lru->last_used)
+            lru = e;
+    }
+    return lru;
+}
+
+// Добавление изображения, вызывается под led_cache_lock. Записи с
+// наименьшим last_used вытесняются, пока новое изображение не уместится
+// в LED_CACHE_MAX_BYTES (само оно сохраняется, даже если больше бюджета).
+// Если такое изображение уже добавлено другим потоком, новое уничтожается.
+// Возвращает изображение из кэша.
+static cairo_surface_t *led_cache_insert(gboolean on, guint32 rgb, gint level, gint size,
+                                         cairo_surface_t *surface)
+{
+    LedCacheEntry *e = led_cache_find(on, rgb, level, size);
+    gsize bytes = led_surface_bytes(surface);
+    
+    if (e) {
+        cairo_surface_destroy(surface);
+        return e->surface;
+    }
+    
+    while (led_cache_bytes && led_cache_bytes + bytes > LED_CACHE_MAX_BYTES)
+        led_cache_evict(led_cache_lru(FALSE));
+    
+    e = led_cache_lru(TRUE);
+    if (e->surface)
+        led_cache_evict(e);
+    
+    e->surface = surface;
+    e->bytes = bytes;
+    led_cache_bytes += bytes;
+    e->on = on;
+    e->rgb = rgb;
+    e->level = level;
+    e->size = size;
+    e->last_used = ++led_cache_clock;
+    return surface;
+}
+
+// Изображение из кэша; при промахе рисуется без блокировки кэша.
+// Возвращает ссылку, которую вызывающий освобождает cairo_surface_destroy().
+static cairo_surface_t *led_cache_get(gboolean on, guint32 rgb, gint brightness, gint size)
 {
-    if (led_state.led_on_surface) {
-        cairo_surface_destroy(led_state.led_on_surface);
+    cairo_surface_t *surface;
+    LedCacheEntry *e;
+    gint level;
+    
+    on = on ? TRUE : FALSE;
+    led_cache_key(on, &rgb, &level, brightness);
+    
+    g_mutex_lock(&led_cache_lock);
+    e = led_cache_find(on, rgb, level, size);
+    if (e) {
+        e->last_used = ++led_cache_clock;
+        surface = cairo_surface_reference(e->surface);
+        g_mutex_unlock(&led_cache_lock);
+        return surface;
     }
-    if (led_state.led_off_surface) {
-        cairo_surface_destroy(led_state.led_off_surface);
+    g_mutex_unlock(&led_cache_lock);
+    
+    // Рисуется яркость уровня, а не исходное значение: изображение
+    // одинаково для всех значений, попадающих в уровень
+    surface = create_led_surface(on, rgb, led_level_brightness(level), size);
+    
+    g_mutex_lock(&led_cache_lock);
+    led_cache_misses++;
+    surface = cairo_surface_reference(led_cache_insert(on, rgb, level, size, surface));
+    g_mutex_unlock(&led_cache_lock);
+    return surface;
+}
+
+static void led_cache_clear(void)
+{
+    g_mutex_lock(&led_cache_lock);
+    for (int i = 0; i < LED_CACHE_SIZE; i++) {
+        if (led_cache[i].surface)
+            led_cache_evict(&led_cache[i]);
     }
+    g_mutex_unlock(&led_cache_lock);
+}
+
+// Предварительная отрисовка всех уровней яркости текущего цвета
+typedef struct {
+    guint32 rgb;
+    gint size;
+} LedPrewarm;
+
+static gpointer led_cache_prewarm_thread(gpointer data)
+{
+    LedPrewarm *job = data;
     
-    led_state.led_on_surface = create_led_surface(TRUE, led_state.color);
-    led_state.led_off_surface = create_led_surface(FALSE, led_state.color);
+    cairo_surface_destroy(led_cache_get(FALSE, 0, 0, job->size));
+    for (gint level = 0; level < LED_CACHE_LEVELS; level++) {
+        cairo_surface_destroy(led_cache_get(TRUE, job->rgb, led_level_brightness(level), job->size));
+    }
+    
+    g_free(job);
+    return NULL;
+}
+
+static gboolean led_prewarm_enabled = FALSE;  // --prewarm
+static GThread *led_prewarm_thread = NULL;
+
+static void led_cache_prewarm(guint32 rgb, gint size)
+{
+    LedPrewarm *job = g_new(LedPrewarm, 1);
     
+    job->rgb = rgb;
+    job->size = size;
+    led_prewarm_thread = g_thread_new("led-prewarm", led_cache_prewarm_thread, job);
+}
+
+// Обновление изображения светодиода: нужное изображение берется из кэша при отрисовке
+static void update_led_image(void)
+{
     if (led_indicator) {
         gtk_widget_queue_draw(led_indicator);
     }
@@ -264,24 +456,25 @@ static gboolean draw_led(GtkWidget *widget, cairo_t *cr, gpointer data)
     int width = gtk_widget_get_allocated_width(widget);
     int height = gtk_widget_get_allocated_height(widget);
     int size = (width < height) ? width : height;
+    int scale = gtk_widget_get_scale_factor(widget);
     
-    cairo_surface_t *surface;
-    if (led_state.led_state) {
-        surface = led_state.led_on_surface;
-    } else {
-        surface = led_state.led_off_surface;
+    // Изображение строится сразу в пикселях экрана, копируется без масштабирования
+    cairo_surface_t *surface = NULL;
+    if (led_prewarm_enabled && !led_prewarm_thread && size > 0)
+        led_cache_prewarm(led_state.rgb, size * scale);
+    if (size > 0) {
+        surface = led_cache_get(led_state.led_state, led_state.rgb,
+                                led_state.brightness, size * scale);
     }
     
     if (surface) {
-        // Вычисляем масштаб
-        double scale = (double)size / 200.0;
-        
         // Сохраняем текущую матрицу трансформации
         cairo_save(cr);
         
         // Центрируем изображение
-        cairo_translate(cr, (width - size) / 2.0, (height - size) / 2.0);
-        cairo_scale(cr, scale, scale);
+        cairo_translate(cr, (width - size) / 2, (height - size) / 2);
+        if (scale > 1)
+            cairo_scale(cr, 1.0 / scale, 1.0 / scale);
         
         // Рисуем изображение
         cairo_set_source_surface(cr, surface, 0, 0);
@@ -289,6 +482,7 @@ static gboolean draw_led(GtkWidget *widget, cairo_t *cr, gpointer data)
         
         // Восстанавливаем матрицу
         cairo_restore(cr);
+        cairo_surface_destroy(surface);
     } else {
         // Резервная отрисовка
         cairo_set_source_rgb(cr, 0.8, 0.8, 0.8);
@@ -310,14 +504,11 @@ static void on_toggle_led(GtkWidget *widget, gpointer data)
     gboolean active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
     led_state.led_state = active;
     
+    write_to_device(VLED_SET_LED_STATE);
     if (active) {
-        write_to_device("ON");
-        write_to_sysfs(SYSFS_STATE, "1");
         gtk_label_set_text(GTK_LABEL(status_label), "LED: ON");
         gui_log("LED turned ON");
     } else {
-        write_to_device("OFF");
-        write_to_sysfs(SYSFS_STATE, "0");
         gtk_label_set_text(GTK_LABEL(status_label), "LED: OFF");
         gui_log("LED turned OFF");
     }
@@ -325,18 +516,40 @@ static void on_toggle_led(GtkWidget *widget, gpointer data)
     update_led_image();
 }
 
-static void on_brightness_changed(GtkRange *range, gpointer data)
+// Ползунок яркости при перетаскивании меняется много раз за кадр. Значения
+// только запоминаются, а раз в кадр последнее из них отправляется фоновым
+// потоком libvled, после чего один раз обновляются статус, лог и картинка.
+static guint brightness_tick_id = 0;
+static gint brightness_sent = -1;   // Последнее отправленное значение
+
+static gboolean brightness_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
 {
-    int brightness = (int)gtk_range_get_value(range);
-    led_state.brightness = brightness;
+    int brightness = led_state.brightness;
     
-    char cmd[50];
-    sprintf(cmd, "BRIGHTNESS %d", brightness);
-    write_to_device(cmd);
+    brightness_tick_id = 0;
+    if (brightness == brightness_sent)
+        return G_SOURCE_REMOVE;
+    brightness_sent = brightness;
     
-    char value[10];
-    sprintf(value, "%d", brightness);
-    write_to_sysfs(SYSFS_BRIGHTNESS, value);
+    if (led) {
+        // Ошибка предыдущей асинхронной отправки, без ожидания
+        int retval = vled_async_error(led);
+        if (retval < 0) {
+            char error_msg[100];
+            snprintf(error_msg, sizeof(error_msg), "ioctl failed: %s", strerror(-retval));
+            gui_log(error_msg);
+        }
+        
+        struct vled_state st = { .mask = VLED_SET_BRIGHTNESS, .brightness = brightness };
+        retval = vled_set_state_async(led, &st);
+        if (retval < 0) {
+            char error_msg[100];
+            snprintf(error_msg, sizeof(error_msg), "Failed to queue update: %s", strerror(-retval));
+            gui_log(error_msg);
+        }
+    } else {
+        gui_log("Device is not open");
+    }
     
     char status[50];
     sprintf(status, "Brightness: %d", brightness);
@@ -347,6 +560,20 @@ static void on_brightness_changed(GtkRange *range, gpointer data)
     gui_log(log_msg);
     
     update_led_image();
+    return G_SOURCE_REMOVE;
+}
+
+static void on_brightness_changed(GtkRange *range, gpointer data)
+{
+    int brightness = (int)gtk_range_get_value(range);
+    
+    // Значение не изменилось - ни отправки, ни перерисовки
+    if (brightness == led_state.brightness)
+        return;
+    led_state.brightness = brightness;
+    
+    if (!brightness_tick_id)
+        brightness_tick_id = gtk_widget_add_tick_callback(GTK_WIDGET(range), brightness_tick, NULL, NULL);
 }
 
 static void on_color_changed(GtkComboBox *combo, gpointer data)
@@ -355,11 +582,9 @@ static void on_color_changed(GtkComboBox *combo, gpointer data)
     if (color) {
         strncpy(led_state.color, color, sizeof(led_state.color) - 1);
         led_state.color[sizeof(led_state.color) - 1] = '\0';
+        vled_color_parse(led_state.color, &led_state.rgb);
         
-        char cmd[50];
-        sprintf(cmd, "COLOR %s", color);
-        write_to_device(cmd);
-        write_to_sysfs(SYSFS_COLOR, color);
+        write_to_device(VLED_SET_COLOR);
         
         char status[50];
         sprintf(status, "Color: %s", color);
@@ -374,50 +599,140 @@ static void on_color_changed(GtkComboBox *combo, gpointer data)
     }
 }
 
-static void on_read_state(GtkWidget *widget, gpointer data)
+// Пока ползунок перетаскивают или значение ждет отправки, яркость
+// из драйвера отстает от ползунка и не должна его перебивать
+static gboolean brightness_busy(void)
 {
-    char state_buf[20], brightness_buf[20], color_buf[20];
+    return brightness_tick_id || gtk_widget_has_grab(brightness_scale);
+}
+
+// Перенос состояния драйвера в виджеты. Обработчики изменений на это
+// время блокируются, чтобы состояние не отправлялось обратно в драйвер.
+static void apply_state(const struct vled_state *st)
+{
+    gboolean keep_brightness = brightness_busy();
     
-    if (read_from_sysfs(SYSFS_STATE, state_buf, sizeof(state_buf)) &&
-        read_from_sysfs(SYSFS_BRIGHTNESS, brightness_buf, sizeof(brightness_buf)) &&
-        read_from_sysfs(SYSFS_COLOR, color_buf, sizeof(color_buf))) {
-        
-        // Обновляем глобальное состояние
-        led_state.led_state = atoi(state_buf);
-        led_state.brightness = atoi(brightness_buf);
-        strncpy(led_state.color, color_buf, sizeof(led_state.color) - 1);
-        
-        // Обновляем UI
-        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(toggle_button), led_state.led_state);
+    // Обновляем глобальное состояние
+    led_state.led_state = st->led_state;
+    if (!keep_brightness) {
+        led_state.brightness = st->brightness;
+        brightness_sent = st->brightness;   // Значение драйвера повторно не отправляется
+    }
+    strncpy(led_state.color, st->color, sizeof(led_state.color) - 1);
+    led_state.rgb = st->rgb;
+    
+    // Обновляем UI
+    g_signal_handlers_block_by_func(toggle_button, on_toggle_led, NULL);
+    g_signal_handlers_block_by_func(brightness_scale, on_brightness_changed, NULL);
+    g_signal_handlers_block_by_func(color_combo, on_color_changed, NULL);
+    
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(toggle_button), led_state.led_state);
+    if (!keep_brightness)
         gtk_range_set_value(GTK_RANGE(brightness_scale), led_state.brightness);
-        
-        // Устанавливаем цвет в комбобоксе
-        GtkComboBoxText *combo = GTK_COMBO_BOX_TEXT(color_combo);
-        GtkTreeModel *model = gtk_combo_box_get_model(GTK_COMBO_BOX(combo));
-        GtkTreeIter iter;
-        gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
-        int index = 0;
-        
-        while (valid) {
-            gchar *item_text;
-            gtk_tree_model_get(model, &iter, 0, &item_text, -1);
-            if (strcmp(item_text, led_state.color) == 0) {
-                gtk_combo_box_set_active(GTK_COMBO_BOX(combo), index);
-                g_free(item_text);
-                break;
-            }
-            g_free(item_text);
-            valid = gtk_tree_model_iter_next(model, &iter);
-            index++;
-        }
-        
-        char status[100];
-        sprintf(status, "State: %s, Brightness: %s, Color: %s", 
-                state_buf, brightness_buf, color_buf);
-        gtk_label_set_text(GTK_LABEL(status_label), status);
-        
-        update_led_image();
-        gui_log("State read from driver");
+    
+    // Пункты комбобокса идут в порядке палитры; цвет вне палитры не выбирается
+    __u32 index = vled_palette_index(st->rgb);
+    if (index < VLED_COLOR_COUNT)
+        gtk_combo_box_set_active(GTK_COMBO_BOX(color_combo), index);
+    
+    g_signal_handlers_unblock_by_func(color_combo, on_color_changed, NULL);
+    g_signal_handlers_unblock_by_func(brightness_scale, on_brightness_changed, NULL);
+    g_signal_handlers_unblock_by_func(toggle_button, on_toggle_led, NULL);
+    
+    char status[100];
+    snprintf(status, sizeof(status), "State: %u, Brightness: %u, Color: %s",
+             st->led_state, st->brightness, st->color);
+    gtk_label_set_text(GTK_LABEL(status_label), status);
+    
+    update_led_image();
+}
+
+static void on_read_state(GtkWidget *widget, gpointer data)
+{
+    struct vled_state st;
+    
+    if (!led) {
+        gui_log("Device is not open");
+        return;
+    }
+    
+    int retval = vled_get_state(led, &st);
+    if (retval < 0) {
+        char error_msg[100];
+        snprintf(error_msg, sizeof(error_msg), "Failed to read state: %s", strerror(-retval));
+        gui_log(error_msg);
+        return;
+    }
+    
+    apply_state(&st);
+    gui_log("State read from driver");
+}
+
+// Живая синхронизация: дескриптор устройства добавлен в главный цикл и
+// становится готов к чтению при любом изменении состояния, в том числе
+// другим процессом. Без изменений программа не просыпается.
+static guint live_sync_id = 0;
+
+static void on_device_changed(struct vled *dev, const struct vled_state *st, gpointer data)
+{
+    // Уведомления о собственных изменениях программы пропускаются
+    if (!st->led_state == !led_state.led_state && st->rgb == led_state.rgb &&
+        ((gint)st->brightness == led_state.brightness || brightness_busy()))
+        return;
+    
+    apply_state(st);
+    
+    char log_msg[100];
+    snprintf(log_msg, sizeof(log_msg), "Driver state changed: %s, brightness %u, color %s",
+             st->led_state ? "ON" : "OFF", st->brightness, st->color);
+    gui_log(log_msg);
+}
+
+static gboolean on_device_event(gint fd, GIOCondition condition, gpointer data)
+{
+    if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+        gui_log("Live sync stopped: device error");
+        live_sync_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    
+    // Один снимок состояния; виджеты обновляет on_device_changed()
+    int retval = vled_dispatch(led);
+    if (retval < 0) {
+        char error_msg[100];
+        snprintf(error_msg, sizeof(error_msg), "Live sync read failed: %s", strerror(-retval));
+        gui_log(error_msg);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void live_sync_start(void)
+{
+    if (!led || live_sync_id)
+        return;
+    vled_set_change_handler(led, on_device_changed, NULL);
+    live_sync_id = g_unix_fd_add(vled_fd(led), G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                 on_device_event, NULL);
+}
+
+static void live_sync_stop(void)
+{
+    if (live_sync_id) {
+        g_source_remove(live_sync_id);
+        live_sync_id = 0;
+    }
+}
+
+static void on_live_sync_toggled(GtkToggleButton *button, gpointer data)
+{
+    if (gtk_toggle_button_get_active(button)) {
+        live_sync_start();
+        // Изменения, пропущенные при выключенной синхронизации
+        on_read_state(NULL, NULL);
+        gui_log("Live sync enabled");
+    } else {
+        live_sync_stop();
+        gui_log("Live sync disabled");
     }
 }
 
@@ -429,6 +744,9 @@ static void on_refresh(GtkWidget *widget, gpointer data)
 static void on_clear_log(GtkWidget *widget, gpointer data)
 {
     gtk_text_buffer_set_text(log_buffer, "", -1);
+    if (log_pending)
+        g_string_truncate(log_pending, 0);
+    log_pending_lines = 0;
     gui_log("Log cleared");
 }
 
@@ -447,7 +765,7 @@ static void on_about(GtkWidget *widget, gpointer data)
     gtk_widget_destroy(dialog);
 }
 
-static void check_driver_availability(void)
+static gboolean check_driver_availability(gpointer data)
 {
     if (access(DEVICE_PATH, F_OK) != 0) {
         GtkWidget *dialog = gtk_message_dialog_new(NULL,
@@ -461,11 +779,411 @@ static void check_driver_availability(void)
         gtk_dialog_run(GTK_DIALOG(dialog));
         gtk_widget_destroy(dialog);
         gui_log("ERROR: Driver not loaded. Please install the driver module.");
+    } else if (!(led = vled_open(0))) {
+        char error_msg[100];
+        snprintf(error_msg, sizeof(error_msg), "ERROR: Failed to open %s: %s",
+                 DEVICE_PATH, strerror(errno));
+        gui_log(error_msg);
     } else {
         gui_log("Driver found. Reading initial state...");
         on_read_state(NULL, NULL);
+        if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(live_sync_check)))
+            live_sync_start();
         gui_log("Application started successfully.");
     }
+    return G_SOURCE_REMOVE;
+}
+
+// Панель из многих светодиодов в одной области отрисовки. Состояние всех
+// светодиодов читается раз в кадр одним GET_FRAME (или генерируется в
+// синтетическом режиме), перерисовываются только изменившиеся ячейки.
+// Спрайты ячеек рисуются один раз на размер ячейки: для цветов палитры -
+// в таблице panel.sprites, для остальных - через общий кэш изображений.
+#define PANEL_DEFAULT_COUNT 4096
+#define PANEL_NUM_DEVICES "/sys/module/virtual_led_driver/parameters/num_devices"
+
+typedef struct {
+    guint32 rgb;
+    guint8 on;
+    guint8 level;               // Яркость, квантованная как в кэше изображений
+} PanelCell;
+
+typedef struct {
+    GtkWidget *window;
+    GtkWidget *area;
+    guint count;
+    gboolean synthetic;         // Генерировать состояние без драйвера
+    struct vled_led_update *updates;    // Буфер для GET_FRAME
+    PanelCell *cells;           // Показанное состояние
+    PanelCell *next;            // Состояние текущего кадра
+    
+    // Раскладка в координатах виджета
+    gint cols, rows, cell, x0, y0;
+    
+    // Спрайты для текущего размера ячейки в пикселях экрана
+    gint sprite_px;
+    cairo_surface_t *sprite_off;
+    cairo_surface_t *sprites[VLED_COLOR_COUNT][LED_CACHE_LEVELS];
+    
+    // Частота кадров для заголовка окна
+    gint64 fps_start;
+    guint frames;
+    guint64 dirty_cells;
+    
+    // Ошибки GET_FRAME: кадры пропускаются до retry_time, интервал растет
+    guint errors;
+    gint64 retry_time;
+} LedPanel;
+
+static LedPanel panel;
+
+static guint panel_default_count(void)
+{
+    FILE *f = fopen(PANEL_NUM_DEVICES, "r");
+    unsigned int count = 0;
+    
+    if (f) {
+        if (fscanf(f, "%u", &count) != 1)
+            count = 0;
+        fclose(f);
+    }
+    return count ? count : 1;
+}
+
+static void panel_sprites_free(void)
+{
+    if (panel.sprite_off)
+        cairo_surface_destroy(panel.sprite_off);
+    panel.sprite_off = NULL;
+    for (int c = 0; c < VLED_COLOR_COUNT; c++) {
+        for (int l = 0; l < LED_CACHE_LEVELS; l++) {
+            if (panel.sprites[c][l])
+                cairo_surface_destroy(panel.sprites[c][l]);
+            panel.sprites[c][l] = NULL;
+        }
+    }
+}
+
+// Спрайт ячейки; возвращает ссылку, которую освобождает вызывающий
+static cairo_surface_t *panel_sprite(const PanelCell *cell)
+{
+    gint brightness = led_level_brightness(cell->level);
+    __u32 index;
+    
+    if (!cell->on) {
+        if (!panel.sprite_off)
+            panel.sprite_off = create_led_surface(FALSE, 0, 0, panel.sprite_px);
+        return cairo_surface_reference(panel.sprite_off);
+    }
+    
+    index = vled_palette_index(cell->rgb);
+    if (index >= VLED_COLOR_COUNT)
+        return led_cache_get(TRUE, cell->rgb, brightness, panel.sprite_px);
+    
+    cairo_surface_t **sprite = &panel.sprites[index][cell->level];
+    if (!*sprite)
+        *sprite = create_led_surface(TRUE, cell->rgb, brightness, panel.sprite_px);
+    return cairo_surface_reference(*sprite);
+}
+
+// Раскладка ячеек по размеру виджета: сетка, близкая к пропорциям области
+static void panel_layout(GtkWidget *widget)
+{
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    int scale = gtk_widget_get_scale_factor(widget);
+    
+    panel.cols = (gint)ceil(sqrt((double)panel.count * width / MAX(height, 1)));
+    panel.cols = CLAMP(panel.cols, 1, (gint)panel.count);
+    panel.rows = (panel.count + panel.cols - 1) / panel.cols;
+    panel.cell = MAX(MIN(width / panel.cols, height / panel.rows), 1);
+    panel.x0 = (width - panel.cols * panel.cell) / 2;
+    panel.y0 = (height - panel.rows * panel.cell) / 2;
+    
+    if (panel.sprite_px != panel.cell * scale) {
+        panel_sprites_free();
+        panel.sprite_px = panel.cell * scale;
+    }
+}
+
+static gboolean panel_draw(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    int scale = gtk_widget_get_scale_factor(widget);
+    GdkRectangle clip;
+    
+    panel_layout(widget);
+    if (!gdk_cairo_get_clip_rectangle(cr, &clip))
+        return FALSE;
+    
+    cairo_set_source_rgb(cr, 0.15, 0.15, 0.15);
+    cairo_paint(cr);
+    
+    // Только ячейки, попадающие в перерисовываемую область
+    gint c0 = MAX((clip.x - panel.x0) / panel.cell, 0);
+    gint r0 = MAX((clip.y - panel.y0) / panel.cell, 0);
+    gint c1 = MIN((clip.x + clip.width - panel.x0) / panel.cell + 1, panel.cols);
+    gint r1 = MIN((clip.y + clip.height - panel.y0) / panel.cell + 1, panel.rows);
+    
+    for (gint r = r0; r < r1; r++) {
+        for (gint c = c0; c < c1; c++) {
+            guint i = r * panel.cols + c;
+            if (i >= panel.count)
+                break;
+            
+            cairo_surface_t *sprite = panel_sprite(&panel.cells[i]);
+            double x = panel.x0 + c * panel.cell;
+            double y = panel.y0 + r * panel.cell;
+            
+            cairo_save(cr);
+            cairo_translate(cr, x, y);
+            if (scale > 1)
+                cairo_scale(cr, 1.0 / scale, 1.0 / scale);
+            cairo_set_source_surface(cr, sprite, 0, 0);
+            cairo_paint(cr);
+            cairo_restore(cr);
+            cairo_surface_destroy(sprite);
+        }
+    }
+    
+    return FALSE;
+}
+
+static void panel_cell_set(PanelCell *cell, gboolean on, guint32 rgb, gint brightness)
+{
+    cell->on = on ? 1 : 0;
+    cell->rgb = on ? rgb : 0;
+    cell->level = on ? led_brightness_level(brightness) : 0;
+}
+
+// Синтетическая нагрузка: волна яркости по всей панели, цвета меняются
+// полосами, каждый светодиод меняется в каждом кадре
+static void panel_synthetic_frame(gint64 frame_time)
+{
+    double t = frame_time / 1e6;
+    
+    for (guint i = 0; i < panel.count; i++) {
+        gint brightness = (gint)(128 + 127 * sin(t * 2 * M_PI * 0.5 + i * 0.1));
+        guint color = (i / 64 + (guint)(t / 2)) % VLED_COLOR_COUNT;
+        panel_cell_set(&panel.next[i], brightness > 8, vled_palette[color].rgb, brightness);
+    }
+}
+
+// Ошибка чтения кадра не останавливает панель: она пишется в журнал и в
+// заголовок окна, а чтение повторяется с растущим интервалом (до 2 с)
+static void panel_driver_error(gint64 frame_time, int error)
+{
+    char msg[128];
+    
+    if (!panel.errors++) {
+        snprintf(msg, sizeof(msg), "Panel: GET_FRAME failed: %s, retrying", strerror(error));
+        gui_log(msg);
+    }
+    panel.retry_time = frame_time + MIN(panel.errors, 8) * G_USEC_PER_SEC / 4;
+    
+    snprintf(msg, sizeof(msg), "LED Panel: %u LEDs - GET_FRAME failed: %s",
+             panel.count, strerror(error));
+    gtk_window_set_title(GTK_WINDOW(panel.window), msg);
+    panel.fps_start = 0;
+    panel.frames = 0;
+    panel.dirty_cells = 0;
+}
+
+static gboolean panel_driver_frame(gint64 frame_time)
+{
+    int retval;
+    
+    if (panel.errors && frame_time < panel.retry_time)
+        return FALSE;
+    
+    retval = led ? vled_get_frame(led, panel.updates, panel.count) : -ENODEV;
+    if (retval < 0) {
+        panel_driver_error(frame_time, -retval);
+        return FALSE;
+    }
+    if (panel.errors) {
+        gui_log("Panel: GET_FRAME recovered");
+        panel.errors = 0;
+    }
+    
+    for (guint i = 0; i < panel.count; i++) {
+        const struct vled_state *st = &panel.updates[i].state;
+        panel_cell_set(&panel.next[i], st->led_state, st->rgb, st->brightness);
+    }
+    return TRUE;
+}
+
+static void panel_update_title(gint64 frame_time)
+{
+    if (!panel.fps_start)
+        panel.fps_start = frame_time;
+    panel.frames++;
+    if (frame_time - panel.fps_start < G_USEC_PER_SEC)
+        return;
+    
+    double seconds = (frame_time - panel.fps_start) / 1e6;
+    char title[128];
+    snprintf(title, sizeof(title), "LED Panel: %u LEDs%s - %.1f fps, %.0f cells/frame",
+             panel.count, panel.synthetic ? " (synthetic)" : "",
+             panel.frames / seconds, (double)panel.dirty_cells / panel.frames);
+    gtk_window_set_title(GTK_WINDOW(panel.window), title);
+    
+    panel.fps_start = frame_time;
+    panel.frames = 0;
+    panel.dirty_cells = 0;
+}
+
+// Раз в кадр: новое состояние, сравнение с показанным, перерисовка
+// изменившихся ячеек. При большом числе изменений перерисовывается вся
+// область - одна операция дешевле тысяч прямоугольников.
+static gboolean panel_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    gint64 frame_time = gdk_frame_clock_get_frame_time(clock);
+    guint dirty = 0;
+    
+    if (panel.synthetic) {
+        panel_synthetic_frame(frame_time);
+    } else if (!panel_driver_frame(frame_time)) {
+        return G_SOURCE_CONTINUE;
+    }
+    
+    panel_layout(widget);
+    for (guint i = 0; i < panel.count; i++)
+        if (memcmp(&panel.cells[i], &panel.next[i], sizeof(PanelCell)) != 0)
+            dirty++;
+    
+    if (dirty > panel.count / 4) {
+        gtk_widget_queue_draw(widget);
+    } else if (dirty) {
+        for (guint i = 0; i < panel.count; i++) {
+            if (memcmp(&panel.cells[i], &panel.next[i], sizeof(PanelCell)) == 0)
+                continue;
+            gtk_widget_queue_draw_area(widget,
+                                       panel.x0 + (i % panel.cols) * panel.cell,
+                                       panel.y0 + (i / panel.cols) * panel.cell,
+                                       panel.cell, panel.cell);
+        }
+    }
+    
+    PanelCell *shown = panel.cells;
+    panel.cells = panel.next;
+    panel.next = shown;
+    
+    panel.dirty_cells += dirty;
+    panel_update_title(frame_time);
+    return G_SOURCE_CONTINUE;
+}
+
+static void panel_destroy(GtkWidget *widget, gpointer data)
+{
+    panel_sprites_free();
+    g_free(panel.updates);
+    g_free(panel.cells);
+    g_free(panel.next);
+    memset(&panel, 0, sizeof(panel));
+}
+
+static void panel_open(guint count, gboolean synthetic)
+{
+    if (panel.window) {
+        gtk_window_present(GTK_WINDOW(panel.window));
+        return;
+    }
+    
+    panel.count = CLAMP(count, 1, VLED_FRAME_MAX);
+    panel.synthetic = synthetic;
+    panel.updates = g_new0(struct vled_led_update, panel.count);
+    panel.cells = g_new0(PanelCell, panel.count);
+    panel.next = g_new0(PanelCell, panel.count);
+    for (guint i = 0; i < panel.count; i++)
+        panel.updates[i].index = i;
+    
+    panel.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(panel.window), "LED Panel");
+    gtk_window_set_default_size(GTK_WINDOW(panel.window), 800, 800);
+    
+    panel.area = gtk_drawing_area_new();
+    gtk_container_add(GTK_CONTAINER(panel.window), panel.area);
+    g_signal_connect(panel.area, "draw", G_CALLBACK(panel_draw), NULL);
+    gtk_widget_add_tick_callback(panel.area, panel_tick, NULL, NULL);
+    g_signal_connect(panel.window, "destroy", G_CALLBACK(panel_destroy), NULL);
+    
+    gtk_widget_show_all(panel.window);
+    
+    char log_msg[100];
+    snprintf(log_msg, sizeof(log_msg), "Panel opened: %u LEDs%s",
+             panel.count, synthetic ? " (synthetic load)" : "");
+    gui_log(log_msg);
+}
+
+// --panel N: открывается после открытия устройства в check_driver_availability()
+static gboolean panel_open_idle(gpointer data)
+{
+    if (!led) {
+        gui_log("Panel: device is not open, use --synthetic");
+        return G_SOURCE_REMOVE;
+    }
+    panel_open(MIN(GPOINTER_TO_UINT(data), panel_default_count()), FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_panel(GtkWidget *widget, gpointer data)
+{
+    // Без драйвера панель показывает синтетическую нагрузку
+    if (led)
+        panel_open(panel_default_count(), FALSE);
+    else
+        panel_open(PANEL_DEFAULT_COUNT, TRUE);
+}
+
+// Замер стоимости обновления изображения: прежняя схема (два изображения
+// 200x200 заново на каждое обновление и вывод с cairo_scale) против кэша.
+// Обновления имитируют движение ползунка яркости с переключениями.
+static void bench_render_paint(cairo_t *cr, cairo_surface_t *surface, double scale)
+{
+    cairo_save(cr);
+    cairo_scale(cr, scale, scale);
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+static int run_bench_render(int updates)
+{
+    const int size = 250;   // Размер области отрисовки по умолчанию
+    cairo_surface_t *target = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    cairo_t *cr = cairo_create(target);
+    gint64 start, uncached_us, cached_us;
+    
+    start = g_get_monotonic_time();
+    for (int i = 0; i < updates; i++) {
+        gboolean on = (i / 64) % 4 != 3;
+        cairo_surface_t *on_surface = create_led_surface(TRUE, 0x00ff00, i % 256, 200);
+        cairo_surface_t *off_surface = create_led_surface(FALSE, 0x00ff00, i % 256, 200);
+        bench_render_paint(cr, on ? on_surface : off_surface, size / 200.0);
+        cairo_surface_destroy(on_surface);
+        cairo_surface_destroy(off_surface);
+    }
+    uncached_us = g_get_monotonic_time() - start;
+    
+    start = g_get_monotonic_time();
+    for (int i = 0; i < updates; i++) {
+        gboolean on = (i / 64) % 4 != 3;
+        cairo_surface_t *surface = led_cache_get(on, 0x00ff00, i % 256, size);
+        bench_render_paint(cr, surface, 1.0);
+        cairo_surface_destroy(surface);
+    }
+    cached_us = g_get_monotonic_time() - start;
+    
+    printf("Render benchmark: %d updates, %dx%d\n", updates, size, size);
+    printf("  %-10s %10.1f us/update\n", "uncached", (double)uncached_us / updates);
+    printf("  %-10s %10.1f us/update (%" G_GUINT64_FORMAT " renders, cache %d entries, %d levels)\n",
+           "cached", (double)cached_us / updates, led_cache_misses,
+           LED_CACHE_SIZE, LED_CACHE_LEVELS);
+    
+    cairo_destroy(cr);
+    cairo_surface_destroy(target);
+    led_cache_clear();
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -479,8 +1197,27 @@ int main(int argc, char *argv[])
     GtkWidget *scrolled_window;
     GtkWidget *menu_bar, *menu, *menu_item;
     
+    // Замер отрисовки не требует дисплея, поэтому до gtk_init()
+    if (argc > 1 && strcmp(argv[1], "--bench-render") == 0) {
+        int updates = argc > 2 ? atoi(argv[2]) : 2000;
+        return run_bench_render(updates > 0 ? updates : 2000);
+    }
+    
     gtk_init(&argc, &argv);
     
+    guint panel_count = 0;
+    gboolean panel_synthetic = FALSE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--prewarm") == 0)
+            led_prewarm_enabled = TRUE;
+        else if (strcmp(argv[i], "--panel") == 0)
+            panel_count = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (guint)atoi(argv[++i]) : PANEL_DEFAULT_COUNT;
+        else if (strcmp(argv[i], "--synthetic") == 0)
+            panel_synthetic = TRUE;
+        else if (strcmp(argv[i], "--log-lines") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            log_max_lines = atoi(argv[++i]);
+    }
+    
     // Создание главного окна
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Virtual LED Controller v2.1");
@@ -497,6 +1234,10 @@ int main(int argc, char *argv[])
     menu_item = gtk_menu_item_new_with_label("File");
     gtk_menu_item_set_submenu(GTK_MENU_ITEM(menu_item), menu);
     
+    GtkWidget *panel_item = gtk_menu_item_new_with_label("LED Panel");
+    g_signal_connect(panel_item, "activate", G_CALLBACK(on_panel), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), panel_item);
+    
     GtkWidget *about_item = gtk_menu_item_new_with_label("About");
     g_signal_connect(about_item, "activate", G_CALLBACK(on_about), NULL);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), about_item);
@@ -556,14 +1297,9 @@ int main(int argc, char *argv[])
     gtk_box_pack_start(GTK_BOX(hbox), color_label, FALSE, FALSE, 0);
     
     color_combo = gtk_combo_box_text_new();
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "red");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "green");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "blue");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "yellow");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "white");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "cyan");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), "magenta");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(color_combo), 1);
+    for (int i = 0; i < VLED_COLOR_COUNT; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(color_combo), vled_palette[i].name);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(color_combo), VLED_COLOR_GREEN);
     gtk_widget_set_size_request(color_combo, 150, -1);
     gtk_box_pack_start(GTK_BOX(hbox), color_combo, FALSE, FALSE, 0);
     g_signal_connect(color_combo, "changed", G_CALLBACK(on_color_changed), NULL);
@@ -591,6 +1327,12 @@ int main(int argc, char *argv[])
     gtk_container_add(GTK_CONTAINER(hbox), clear_button);
     g_signal_connect(clear_button, "clicked", G_CALLBACK(on_clear_log), NULL);
     
+    live_sync_check = gtk_check_button_new_with_label("Live sync");
+    gtk_widget_set_tooltip_text(live_sync_check, "Update display as soon as the driver state changes");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(live_sync_check), TRUE);
+    gtk_container_add(GTK_CONTAINER(hbox), live_sync_check);
+    g_signal_connect(live_sync_check, "toggled", G_CALLBACK(on_live_sync_toggled), NULL);
+    
     // Статусная строка
     frame = gtk_frame_new("Status");
     gtk_frame_set_shadow_type(GTK_FRAME(frame), GTK_SHADOW_ETCHED_IN);
@@ -617,6 +1359,7 @@ int main(int argc, char *argv[])
     gtk_container_add(GTK_CONTAINER(frame), scrolled_window);
     
     log_textview = gtk_text_view_new();
+    g_signal_connect(log_textview, "destroy", G_CALLBACK(gtk_widget_destroyed), &log_textview);
     gtk_text_view_set_editable(GTK_TEXT_VIEW(log_textview), FALSE);
     gtk_text_view_set_monospace(GTK_TEXT_VIEW(log_textview), TRUE);
     gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(log_textview), GTK_WRAP_WORD_CHAR);
@@ -630,21 +1373,27 @@ int main(int argc, char *argv[])
     // Обработчик отрисовки светодиода
     g_signal_connect(G_OBJECT(drawing_area), "draw", G_CALLBACK(draw_led), NULL);
     
-    // Инициализация изображений светодиода
-    update_led_image();
-    
     gtk_widget_show_all(window);
     
     // Запускаем проверку драйвера после отображения окна
-    g_idle_add((GSourceFunc)check_driver_availability, NULL);
+    g_idle_add(check_driver_availability, NULL);
+    
+    // Панель с синтетической нагрузкой не требует драйвера
+    if (panel_synthetic)
+        panel_open(panel_count ? panel_count : PANEL_DEFAULT_COUNT, TRUE);
+    else if (panel_count)
+        g_idle_add((GSourceFunc)panel_open_idle, GUINT_TO_POINTER(panel_count));
     
     gtk_main();
     
     // Очистка ресурсов
-    if (led_state.led_on_surface)
-        cairo_surface_destroy(led_state.led_on_surface);
-    if (led_state.led_off_surface)
-        cairo_surface_destroy(led_state.led_off_surface);
+    live_sync_stop();
+    vled_close(led);
+    if (log_pending)
+        g_string_free(log_pending, TRUE);
+    if (led_prewarm_thread)
+        g_thread_join(led_prewarm_thread);
+    led_cache_clear();
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "libvled.h"
+#include "vled_core.h"
+
+#define VLED_DEVICE_FMT "/dev/vled%u"
+
+struct vled {
+    int fd;
+    const struct vled_shared_page *page;    // NULL, если mmap недоступен
+    pthread_mutex_t lock;
+    
+    // Кэш состояния
+    struct vled_state cache;
+    __u32 cache_seq;            // Версия страницы mmap, из которой взят кэш
+    int cache_valid;
+    
+    vled_change_fn on_change;
+    void *on_change_data;
+    
+    // Асинхронная отправка
+    pthread_t worker;
+    pthread_cond_t cond;        // Появились изменения или отправка завершена
+    struct vled_state pending;  // pending.mask == 0 - отправлять нечего
+    int worker_started;
+    int in_flight;
+    int stopping;
+    int async_error;
+    
+    struct vled_client_stats stats;
+};
+
+struct vled *vled_open(unsigned int index)
+{
+    struct pollfd pfd;
+    char path[32];
+    struct vled *led;
+    void *page;
+    
+    led = calloc(1, sizeof(*led));
+    if (!led)
+        return NULL;
+    
+    snprintf(path, sizeof(path), VLED_DEVICE_FMT, index);
+    led->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (led->fd < 0 && errno == EACCES)
+        led->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (led->fd < 0) {
+        free(led);
+        return NULL;
+    }
+    
+    page = mmap(NULL, sizeof(*led->page), PROT_READ, MAP_SHARED, led->fd, 0);
+    led->page = page == MAP_FAILED ? NULL : page;
+    
+    // Первый poll() заводит в драйвере отслеживание изменений для дескриптора
+    pfd.fd = led->fd;
+    pfd.events = POLLIN;
+    poll(&pfd, 1, 0);
+    
+    pthread_mutex_init(&led->lock, NULL);
+    pthread_cond_init(&led->cond, NULL);
+    return led;
+}
+
+void vled_close(struct vled *led)
+{
+    if (!led)
+        return;
+    
+    // Фоновый поток отправляет накопленное перед завершением
+    if (led->worker_started) {
+        pthread_mutex_lock(&led->lock);
+        led->stopping = 1;
+        pthread_cond_broadcast(&led->cond);
+        pthread_mutex_unlock(&led->lock);
+        pthread_join(led->worker, NULL);
+    }
+    
+    if (led->page)
+        munmap((void *)led->page, sizeof(*led->page));
+    close(led->fd);
+    pthread_cond_destroy(&led->cond);
+    pthread_mutex_destroy(&led->lock);
+    free(led);
+}
+
+int vled_fd(const struct vled *led)
+{
+    return led->fd;
+}
+
+static int vled_ioctl(struct vled *led, unsigned long request, const void *arg)
+{
+    return ioctl(led->fd, request, arg) < 0 ? -errno : 0;
+}
+
+// Ожидание отправки накопленных изменений, вызывается под lock
+static void vled_drain(struct vled *led)
+{
+    while (led->pending.mask || led->in_flight)
+        pthread_cond_wait(&led->cond, &led->lock);
+}
+
+// Перед синхронным изменением: накопленные асинхронные изменения
+// должны попасть в драйвер раньше
+static void vled_sync_begin(struct vled *led)
+{
+    if (!led->worker_started)
+        return;
+    pthread_mutex_lock(&led->lock);
+    vled_drain(led);
+    pthread_mutex_unlock(&led->lock);
+}
+
+int vled_set_state(struct vled *led, const struct vled_state *st)
+{
+    int retval;
+    
+    vled_sync_begin(led);
+    retval = vled_ioctl(led, VLED_IOC_SET_STATE, st);
+    if (!led->page) {
+        pthread_mutex_lock(&led->lock);
+        led->cache_valid = 0;
+        pthread_mutex_unlock(&led->lock);
+    }
+    return retval;
+}
+
+int vled_update_state(struct vled *led, struct vled_state_update *upd)
+{
+    __u32 mask = upd->state.mask;
+    int retval;
+    
+    vled_sync_begin(led);
+    retval = ioctl(led->fd, VLED_IOC_UPDATE_STATE, upd) < 0 ? -errno : 0;
+    if (!led->page && mask) {
+        pthread_mutex_lock(&led->lock);
+        led->cache_valid = 0;
+        pthread_mutex_unlock(&led->lock);
+    }
+    return retval;
+}
+
+int vled_set_on(struct vled *led, int on)
+{
+    struct vled_state st = { .mask = VLED_SET_LED_STATE, .led_state = on ? 1 : 0 };
+    return vled_set_state(led, &st);
+}
+
+int vled_set_brightness(struct vled *led, unsigned int brightness)
+{
+    struct vled_state st = { .mask = VLED_SET_BRIGHTNESS, .brightness = brightness };
+    return vled_set_state(led, &st);
+}
+
+// Имя переводится в RGB по палитре на стороне клиента,
+// драйверу не нужно разбирать строку
+int vled_set_color(struct vled *led, const char *color)
+{
+    struct vled_state st = { .mask = VLED_SET_RGB };
+    
+    if (vled_color_parse(color, &st.rgb))
+        return -EINVAL;
+    return vled_set_state(led, &st);
+}
+
+int vled_set_rgb(struct vled *led, __u32 rgb)
+{
+    struct vled_state st = { .mask = VLED_SET_RGB, .rgb = rgb };
+    return vled_set_state(led, &st);
+}
+
+int vled_set_effect(struct vled *led, const struct vled_effect *eff)
+{
+    vled_sync_begin(led);
+    return vled_ioctl(led, VLED_IOC_SET_EFFECT, eff);
+}
+
+int vled_set_frame(struct vled *led, const struct vled_led_update *updates, __u32 count)
+{
+    struct vled_frame frame = { .count = count, .updates = (__u64)(unsigned long)updates };
+    
+    vled_sync_begin(led);
+    return vled_ioctl(led, VLED_IOC_SET_FRAME, &frame);
+}
+
+// Драйвер выполняет хвост без '\n' только при fsync() или закрытии,
+// поэтому недостающий '\n' добавляется той же записью
+int vled_command(struct vled *led, const char *command)
+{
+    size_t len = strlen(command);
+    struct iovec iov[2] = {
+        { .iov_base = (void *)command, .iov_len = len },
+        { .iov_base = "\n", .iov_len = 1 },
+    };
+    int count = len && command[len - 1] == '\n' ? 1 : 2;
+    ssize_t written;
+    
+    vled_sync_begin(led);
+    written = writev(led->fd, iov, count);
+    if (written < 0)
+        return -errno;
+    return (size_t)written == len + (count - 1) ? 0 : -EIO;
+}
+
+int vled_write_status(struct vled *led, struct vled_write_status *status)
+{
+    return vled_ioctl(led, VLED_IOC_GET_WRITE_STATUS, status);
+}
+
+// Фоновый поток: отправляет объединенные изменения одним ioctl
+static void *vled_worker(void *arg)
+{
+    struct vled *led = arg;
+    
+    pthread_mutex_lock(&led->lock);
+    for (;;) {
+        struct vled_state st;
+        int retval;
+        
+        while (!led->pending.mask && !led->stopping)
+            pthread_cond_wait(&led->cond, &led->lock);
+        if (!led->pending.mask)
+            break;
+        
+        st = led->pending;
+        led->pending.mask = 0;
+        led->in_flight = 1;
+        pthread_mutex_unlock(&led->lock);
+        
+        retval = vled_ioctl(led, VLED_IOC_SET_STATE, &st);
+        
+        pthread_mutex_lock(&led->lock);
+        led->in_flight = 0;
+        led->stats.sent++;
+        if (retval)
+            led->async_error = retval;
+        if (!led->page)
+            led->cache_valid = 0;
+        pthread_cond_broadcast(&led->cond);
+    }
+    pthread_mutex_unlock(&led->lock);
+    return NULL;
+}
+
+int vled_set_state_async(struct vled *led, const struct vled_state *st)
+{
+    int retval = 0;
+    
+    pthread_mutex_lock(&led->lock);
+    if (!led->worker_started) {
+        retval = -pthread_create(&led->worker, NULL, vled_worker, led);
+        led->worker_started = !retval;
+    }
+    if (!retval) {
+        vled_state_merge(&led->pending, st);
+        led->stats.queued++;
+        pthread_cond_broadcast(&led->cond);
+    }
+    pthread_mutex_unlock(&led->lock);
+    return retval;
+}
+
+int vled_flush(struct vled *led)
+{
+    int retval;
+    
+    pthread_mutex_lock(&led->lock);
+    vled_drain(led);
+    retval = led->async_error;
+    led->async_error = 0;
+    pthread_mutex_unlock(&led->lock);
+    return retval;
+}
+
+int vled_async_error(struct vled *led)
+{
+    int retval;
+    
+    pthread_mutex_lock(&led->lock);
+    retval = led->async_error;
+    led->async_error = 0;
+    pthread_mutex_unlock(&led->lock);
+    return retval;
+}
+
+// Обновление кэша, вызывается под lock. Со страницей mmap проверка
+// актуальности - одно чтение счетчика версий; без нее - poll() без ожидания.
+static int vled_cache_update(struct vled *led)
+{
+    if (led->page) {
+        if (led->cache_valid &&
+            __atomic_load_n(&led->page->seq, __ATOMIC_ACQUIRE) == led->cache_seq) {
+            led->stats.cache_hits++;
+            return 0;
+        }
+        led->cache_seq = vled_shared_read(led->page, &led->cache, NULL);
+    } else {
+        struct pollfd pfd = { .fd = led->fd, .events = POLLIN };
+        
+        if (led->cache_valid && poll(&pfd, 1, 0) == 0) {
+            led->stats.cache_hits++;
+            return 0;
+        }
+        if (ioctl(led->fd, VLED_IOC_GET_STATE, &led->cache) < 0)
+            return -errno;
+    }
+    
+    led->cache_valid = 1;
+    led->stats.cache_misses++;
+    return 0;
+}
+
+int vled_get_state(struct vled *led, struct vled_state *st)
+{
+    int retval;
+    
+    pthread_mutex_lock(&led->lock);
+    retval = vled_cache_update(led);
+    if (!retval)
+        *st = led->cache;
+    pthread_mutex_unlock(&led->lock);
+    return retval;
+}
+
+int vled_get_frame(struct vled *led, struct vled_led_update *updates, __u32 count)
+{
+    struct vled_frame frame = { .count = count, .updates = (__u64)(unsigned long)updates };
+    
+    return vled_ioctl(led, VLED_IOC_GET_FRAME, &frame);
+}
+
+int vled_dispatch(struct vled *led)
+{
+    struct pollfd pfd = { .fd = led->fd, .events = POLLIN };
+    struct vled_state st;
+    vled_change_fn fn;
+    void *data;
+    char buffer[128];
+    int retval;
+    
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+        return 0;
+    
+    // Чтение снимка отмечает изменение как полученное этим дескриптором
+    if (pread(led->fd, buffer, sizeof(buffer), 0) < 0)
+        return -errno;
+    
+    pthread_mutex_lock(&led->lock);
+    led->cache_valid = 0;
+    retval = vled_cache_update(led);
+    st = led->cache;
+    fn = led->on_change;
+    data = led->on_change_data;
+    pthread_mutex_unlock(&led->lock);
+    
+    if (retval)
+        return retval;
+    if (fn)
+        fn(led, &st, data);
+    return 1;
+}
+
+void vled_set_change_handler(struct vled *led, vled_change_fn fn, void *data)
+{
+    pthread_mutex_lock(&led->lock);
+    led->on_change = fn;
+    led->on_change_data = data;
+    pthread_mutex_unlock(&led->lock);
+}
+
+int vled_wait(struct vled *led, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = led->fd, .events = POLLIN };
+    int ready = poll(&pfd, 1, timeout_ms);
+    
+    if (ready < 0)
+        return -errno;
+    if (ready == 0)
+        return 0;
+    return vled_dispatch(led);
+}
+
+void vled_get_stats(struct vled *led, struct vled_client_stats *stats)
+{
+    pthread_mutex_lock(&led->lock);
+    *stats = led->stats;
+    pthread_mutex_unlock(&led->lock);
+}
@@ -0,0 +1,109 @@
+#ifndef _LIBVLED_H
+#define _LIBVLED_H
+
+#include "vled_ioctl.h"
+
+// Клиентская библиотека для /dev/vledN.
+// Дескриптор устройства открывается один раз на все время работы, состояние
+// читается из кэша, который обновляется только после уведомления драйвера
+// об изменении. Функции возвращают 0 или -errno, если не сказано иное.
+// Один struct vled можно использовать из нескольких потоков.
+
+struct vled;
+
+// Статистика клиента, см. vled_get_stats()
+struct vled_client_stats {
+    unsigned long queued;       // Вызовов vled_set_state_async()
+    unsigned long sent;         // ioctl, отправленных фоновым потоком
+    unsigned long cache_hits;   // vled_get_state() без обращения к драйверу
+    unsigned long cache_misses; // Обновлений кэша после изменения состояния
+};
+
+// Обработчик изменений, вызывается из vled_dispatch()
+typedef void (*vled_change_fn)(struct vled *led, const struct vled_state *st, void *data);
+
+// Открытие /dev/vled<index>; NULL и errno при ошибке.
+// Без прав на запись устройство открывается только для чтения.
+struct vled *vled_open(unsigned int index);
+void vled_close(struct vled *led);
+
+// Дескриптор для poll() или главного цикла: готов к чтению, когда
+// состояние изменилось; после этого нужно вызвать vled_dispatch()
+int vled_fd(const struct vled *led);
+
+// Синхронный интерфейс: изменение применено к моменту возврата
+int vled_set_state(struct vled *led, const struct vled_state *st);
+int vled_set_on(struct vled *led, int on);
+int vled_set_brightness(struct vled *led, unsigned int brightness);
+int vled_set_color(struct vled *led, const char *color);   // Имя из палитры или #rrggbb
+int vled_set_rgb(struct vled *led, __u32 rgb);
+int vled_set_effect(struct vled *led, const struct vled_effect *eff);
+// Транзакционное изменение, см. struct vled_state_update: с флагом
+// VLED_UPDATE_IF_SEQ применяется, только если версия состояния равна
+// upd->expected_seq, иначе -EAGAIN. В upd возвращаются состояние и версия,
+// по которым можно повторить попытку.
+int vled_update_state(struct vled *led, struct vled_state_update *upd);
+int vled_set_frame(struct vled *led, const struct vled_led_update *updates, __u32 count);
+// Текстовая команда или несколько команд, разделенных '\n', одной записью;
+// последняя команда завершается '\n', если его нет
+int vled_command(struct vled *led, const char *command);
+// Итог последней записи через vled_command(): число команд и первая ошибка
+int vled_write_status(struct vled *led, struct vled_write_status *status);
+
+// Асинхронный интерфейс: изменения накапливаются и отправляются фоновым
+// потоком. Поле, измененное несколько раз до отправки, уходит в драйвер
+// один раз с последним значением. Синхронные вызовы сначала дожидаются
+// отправки накопленного, поэтому порядок изменений сохраняется.
+int vled_set_state_async(struct vled *led, const struct vled_state *st);
+// Дождаться отправки всех накопленных изменений; возвращает ошибку
+// последней неудачной асинхронной отправки и сбрасывает ее
+int vled_flush(struct vled *led);
+// То же без ожидания: ошибка уже завершенной асинхронной отправки или 0
+int vled_async_error(struct vled *led);
+
+// Текущее состояние из кэша
+int vled_get_state(struct vled *led, struct vled_state *st);
+// Состояние светодиодов updates[i].index одним ioctl, согласованное
+// относительно кадров; кэш не используется
+int vled_get_frame(struct vled *led, struct vled_led_update *updates, __u32 count);
+
+// Обработка уведомления: сбрасывает кэш и вызывает обработчик изменений.
+// Возвращает 1, если состояние изменилось, 0 - если нет.
+int vled_dispatch(struct vled *led);
+void vled_set_change_handler(struct vled *led, vled_change_fn fn, void *data);
+// Ожидание изменения: 1 - изменилось, 0 - истек timeout_ms (-1 - без ограничения)
+int vled_wait(struct vled *led, int timeout_ms);
+
+void vled_get_stats(struct vled *led, struct vled_client_stats *stats);
+
+// Чтение страницы состояния без системных вызовов.
+// page - результат mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0).
+// Возвращает номер версии снимка.
+static inline __u32 vled_shared_read(const struct vled_shared_page *page,
+                                     struct vled_state *st, __u32 *color_index)
+{
+    __u32 seq;
+    
+    for (;;) {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        
+        st->mask = VLED_SET_ALL;
+        st->led_state = __atomic_load_n(&page->led_state, __ATOMIC_RELAXED);
+        st->brightness = __atomic_load_n(&page->brightness, __ATOMIC_RELAXED);
+        st->rgb = __atomic_load_n(&page->rgb, __ATOMIC_RELAXED);
+        if (color_index)
+            *color_index = __atomic_load_n(&page->color_index, __ATOMIC_RELAXED);
+        __builtin_memcpy(st->color, (const char *)page->color, sizeof(st->color));
+        
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+    
+    st->color[sizeof(st->color) - 1] = '\0';
+    return seq;
+}
+
+#endif /* _LIBVLED_H */
@@ -4,11 +4,68 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/utsname.h>
 
-#define DEVICE_PATH "/dev/vled"
-#define SYSFS_STATE "/sys/class/vled/vled/led_state"
-#define SYSFS_BRIGHTNESS "/sys/class/vled/vled/brightness"
-#define SYSFS_COLOR "/sys/class/vled/vled/color"
+#include "libvled.h"
+#include "vled_core.h"
+
+#define DEVICE_PATH "/dev/vled0"
+#define EVENTS_PATH "/dev/vled0_events"
+#define SYSFS_DIR_FMT "/sys/class/vled/vled%u"
+#define SYSFS_STATE sysfs_path(0, "led_state")
+#define SYSFS_BRIGHTNESS sysfs_path(1, "brightness")
+#define SYSFS_COLOR sysfs_path(2, "color")
+#define SYSFS_STATE_ALL sysfs_path(3, "state")
+#define DEVICE_PATH_FMT "/dev/vled%d"
+#define PARAM_NUM_DEVICES "/sys/module/virtual_led_driver/parameters/num_devices"
+
+// Постоянное соединение с /dev/vled0 на все время работы программы
+static struct vled *led;
+
+// Каталог атрибутов: VLED_SYSFS_DIR, например каталог --attrs симулятора
+// vled_sim, или /sys/class/vled/vled<device>. Путь хранится в буфере slot,
+// чтобы несколько путей можно было использовать одновременно.
+static const char *sysfs_attr_path(int slot, unsigned int device, const char *attr)
+{
+    static char paths[4][128];
+    const char *dir = getenv("VLED_SYSFS_DIR");
+    
+    if (dir)
+        snprintf(paths[slot], sizeof(paths[slot]), "%s/%s", dir, attr);
+    else
+        snprintf(paths[slot], sizeof(paths[slot]), SYSFS_DIR_FMT "/%s", device, attr);
+    return paths[slot];
+}
+
+static const char *sysfs_path(int slot, const char *attr)
+{
+    return sysfs_attr_path(slot, 0, attr);
+}
+
+// Атрибут state: все поля и версия одним чтением из одного снимка.
+// Дескриптор открыт все время работы, pread() с позиции 0 дает новый снимок.
+static int sysfs_state_fd = -1;
+
+static int read_sysfs_state(char *buffer, size_t size)
+{
+    ssize_t bytes;
+    
+    if (sysfs_state_fd < 0)
+        sysfs_state_fd = open(SYSFS_STATE_ALL, O_RDONLY | O_CLOEXEC);
+    if (sysfs_state_fd < 0)
+        return -errno;
+    bytes = pread(sysfs_state_fd, buffer, size - 1, 0);
+    if (bytes < 0)
+        return -errno;
+    buffer[bytes] = '\0';
+    return bytes;
+}
 
 void print_state(const char *label)
 {
@@ -17,78 +74,1237 @@ void print_state(const char *label)
     
     // Чтение через sysfs
     char buffer[256];
-    FILE *fp;
+    char color[VLED_COLOR_LEN];
+    unsigned int state, brightness, seq;
+    int bytes = read_sysfs_state(buffer, sizeof(buffer));
+    
+    if (bytes < 0)
+        printf("Error reading %s: %s\n", SYSFS_STATE_ALL, strerror(-bytes));
+    else if (sscanf(buffer, "led_state=%u\nbrightness=%u\ncolor=%15s\nrgb=%*x\nseq=%u",
+                    &state, &brightness, color, &seq) == 4)
+        printf("State: %u\nBrightness: %u\nColor: %s\nVersion: %u\n", state, brightness, color, seq);
+    else
+        printf("Unexpected sysfs state: %s", buffer);
     
-    fp = fopen(SYSFS_STATE, "r");
+    // Чтение через устройство (кэш libvled)
+    struct vled_state st;
+    int retval = vled_get_state(led, &st);
+    printf("Device output:\n");
+    if (retval == 0) {
+        printf("LED State: %s\nBrightness: %u\nColor: %s (rgb %06x)\n",
+               st.led_state ? "ON" : "OFF", st.brightness, st.color, st.rgb);
+    } else {
+        printf("Error reading state: %s\n", strerror(-retval));
+    }
+}
+
+void set_device_state(const struct vled_state *st)
+{
+    int retval = vled_set_state(led, st);
+    if (retval < 0)
+        printf("Error setting state: %s\n", strerror(-retval));
+    else
+        printf("State applied (mask 0x%x)\n", st->mask);
+}
+
+void set_led(int on)
+{
+    struct vled_state st = { .mask = VLED_SET_LED_STATE, .led_state = on };
+    set_device_state(&st);
+}
+
+void set_brightness(int brightness)
+{
+    struct vled_state st = { .mask = VLED_SET_BRIGHTNESS, .brightness = brightness };
+    set_device_state(&st);
+}
+
+void set_color(const char *color)
+{
+    int retval = vled_set_color(led, color);
+    if (retval < 0)
+        printf("Error setting color: %s\n", strerror(-retval));
+    else
+        printf("Color applied: %s\n", color);
+}
+
+void write_command(const char *command)
+{
+    int retval = vled_command(led, command);
+    if (retval < 0)
+        printf("Error writing command: %s\n", strerror(-retval));
+    else
+        printf("Command executed: %s\n", command);
+}
+
+void write_sysfs(const char *path, const char *value)
+{
+    FILE *fp = fopen(path, "w");
     if (fp) {
-        fgets(buffer, sizeof(buffer), fp);
-        printf("State: %s", buffer);
+        fprintf(fp, "%s", value);
         fclose(fp);
+        printf("Sysfs write: %s = %s\n", path, value);
+    } else {
+        printf("Error writing to %s: %s\n", path, strerror(errno));
     }
+}
+
+// Проверка состояния после шага демонстрации; -1 - поле не проверяется
+static int check_failures;
+
+void expect_state(int on, int brightness, long rgb)
+{
+    struct vled_state st;
+    int retval = vled_get_state(led, &st);
     
-    fp = fopen(SYSFS_BRIGHTNESS, "r");
-    if (fp) {
-        fgets(buffer, sizeof(buffer), fp);
-        printf("Brightness: %s", buffer);
-        fclose(fp);
+    if (retval < 0) {
+        printf("CHECK FAILED: cannot read state: %s\n", strerror(-retval));
+        check_failures++;
+    } else if ((on >= 0 && st.led_state != (__u32)on) ||
+               (brightness >= 0 && st.brightness != (__u32)brightness) ||
+               (rgb >= 0 && st.rgb != (__u32)rgb)) {
+        printf("CHECK FAILED: state %u brightness %u rgb %06x\n", st.led_state, st.brightness, st.rgb);
+        check_failures++;
+    } else {
+        printf("CHECK OK\n");
     }
+}
+
+// Проверка итога последней записи команд
+void expect_write_status(unsigned int commands, unsigned int rejected)
+{
+    struct vled_write_status ws;
+    int retval = vled_write_status(led, &ws);
     
-    fp = fopen(SYSFS_COLOR, "r");
-    if (fp) {
-        fgets(buffer, sizeof(buffer), fp);
-        printf("Color: %s", buffer);
-        fclose(fp);
+    if (retval < 0) {
+        printf("CHECK FAILED: cannot read write status: %s\n", strerror(-retval));
+        check_failures++;
+    } else if (ws.commands != commands || ws.rejected != rejected) {
+        printf("CHECK FAILED: %u commands, %u rejected (first %u, error %d)\n",
+               ws.commands, ws.rejected, ws.first_error, ws.error);
+        check_failures++;
+    } else {
+        printf("CHECK OK: %u commands applied\n", ws.applied);
     }
+}
+
+// Стресс-тест: писатели атомарно применяют согласованные тройки
+// {state, brightness, color}, читатели проверяют, что тройка не разорвана
+// Цвета берутся из палитры драйвера по номеру яркости
+#define stress_color(brightness) vled_palette[(brightness) % VLED_COLOR_COUNT].name
+
+static atomic_int stress_stop;
+static atomic_ulong stress_reads;
+static atomic_ulong stress_writes;
+static atomic_ulong stress_torn;
+
+static int stress_consistent(unsigned int state, unsigned int brightness, const char *color)
+{
+    return state == (brightness & 1) &&
+           strcmp(color, stress_color(brightness)) == 0;
+}
+
+static void *stress_writer(void *arg)
+{
+    unsigned int k = (unsigned int)(unsigned long)arg;
+    unsigned long writes = 0;
+    int fd = open(DEVICE_PATH, O_WRONLY);
+    if (fd < 0)
+        return NULL;
     
-    // Чтение через устройство
+    while (!atomic_load_explicit(&stress_stop, memory_order_relaxed)) {
+        struct vled_state st = { .mask = VLED_SET_ALL };
+        st.brightness = k++ % 256;
+        st.led_state = st.brightness & 1;
+        strcpy(st.color, stress_color(st.brightness));
+        if (ioctl(fd, VLED_IOC_SET_STATE, &st) == 0)
+            writes++;
+    }
+    
+    close(fd);
+    atomic_fetch_add(&stress_writes, writes);
+    return NULL;
+}
+
+// Читатели с четным номером используют ioctl, с нечетным - текстовый read()
+static void *stress_reader(void *arg)
+{
+    int use_text = (int)(unsigned long)arg & 1;
+    unsigned long reads = 0, torn = 0;
     int fd = open(DEVICE_PATH, O_RDONLY);
-    if (fd >= 0) {
-        printf("Device output:\n");
-        int bytes = read(fd, buffer, sizeof(buffer)-1);
-        if (bytes > 0) {
+    if (fd < 0)
+        return NULL;
+    
+    while (!atomic_load_explicit(&stress_stop, memory_order_relaxed)) {
+        unsigned int state, brightness;
+        char color[VLED_COLOR_LEN];
+        
+        if (use_text) {
+            char buffer[256], onoff[4];
+            ssize_t bytes = pread(fd, buffer, sizeof(buffer) - 1, 0);
+            if (bytes <= 0)
+                continue;
             buffer[bytes] = '\0';
-            printf("%s", buffer);
+            if (sscanf(buffer, "LED State: %3s\nBrightness: %u\nColor: %15s",
+                       onoff, &brightness, color) != 3)
+                continue;
+            state = strcmp(onoff, "ON") == 0;
+        } else {
+            struct vled_state st;
+            if (ioctl(fd, VLED_IOC_GET_STATE, &st) < 0)
+                continue;
+            state = st.led_state;
+            brightness = st.brightness;
+            memcpy(color, st.color, sizeof(color));
         }
-        close(fd);
+        
+        reads++;
+        if (!stress_consistent(state, brightness, color))
+            torn++;
     }
+    
+    close(fd);
+    atomic_fetch_add(&stress_reads, reads);
+    atomic_fetch_add(&stress_torn, torn);
+    return NULL;
 }
 
-void write_command(const char *command)
+static int run_stress(int readers, int writers, int seconds)
 {
-    int fd = open(DEVICE_PATH, O_WRONLY);
+    pthread_t threads[readers + writers];
+    struct timespec start, end;
+    double elapsed;
+    int i;
+    
+    printf("Stress test: %d readers, %d writers, %d s\n", readers, writers, seconds);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < writers; i++)
+        pthread_create(&threads[i], NULL, stress_writer, (void *)(unsigned long)(i * 37));
+    for (i = 0; i < readers; i++)
+        pthread_create(&threads[writers + i], NULL, stress_reader, (void *)(unsigned long)i);
+    
+    sleep(seconds);
+    atomic_store(&stress_stop, 1);
+    
+    for (i = 0; i < readers + writers; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Reads:  %lu (%.0f/s)\n", atomic_load(&stress_reads), atomic_load(&stress_reads) / elapsed);
+    printf("Writes: %lu (%.0f/s)\n", atomic_load(&stress_writes), atomic_load(&stress_writes) / elapsed);
+    printf("Torn reads: %lu\n", atomic_load(&stress_torn));
+    
+    return atomic_load(&stress_torn) ? 1 : 0;
+}
+
+// Сравнение стоимости одного опроса состояния разными способами
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *name, long iterations, double elapsed)
+{
+    printf("%-22s %10.1f ns/poll %12.0f polls/s\n",
+           name, elapsed * 1e9 / iterations, iterations / elapsed);
+}
+
+static int run_poll_bench(long iterations)
+{
+    const struct vled_shared_page *page;
+    struct vled_state st;
+    char buffer[256];
+    volatile __u32 sink = 0;
+    double start;
+    long i;
+    
+    int fd = open(DEVICE_PATH, O_RDONLY);
     if (fd < 0) {
         printf("Error opening device: %s\n", strerror(errno));
-        return;
+        return 1;
+    }
+    
+    page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        printf("mmap failed: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+    
+    printf("Polling benchmark: %ld iterations\n", iterations);
+    
+    start = now_sec();
+    for (i = 0; i < iterations; i++)
+        sink += vled_shared_read(page, &st, NULL);
+    bench_report("mmap", iterations, now_sec() - start);
+    
+    start = now_sec();
+    for (i = 0; i < iterations; i++) {
+        vled_get_state(led, &st);
+        sink += st.brightness;
     }
+    bench_report("libvled cache", iterations, now_sec() - start);
     
-    write(fd, command, strlen(command));
+    start = now_sec();
+    for (i = 0; i < iterations; i++) {
+        ioctl(fd, VLED_IOC_GET_STATE, &st);
+        sink += st.brightness;
+    }
+    bench_report("ioctl GET_STATE", iterations, now_sec() - start);
+    
+    start = now_sec();
+    for (i = 0; i < iterations; i++)
+        sink += pread(fd, buffer, sizeof(buffer), 0);
+    bench_report("read() kept-open fd", iterations, now_sec() - start);
+    
+    // Как print_state(): три атрибута sysfs, открытие на каждый опрос
+    start = now_sec();
+    for (i = 0; i < iterations; i++) {
+        const char *paths[] = { SYSFS_STATE, SYSFS_BRIGHTNESS, SYSFS_COLOR };
+        for (int j = 0; j < 3; j++) {
+            int sfd = open(paths[j], O_RDONLY);
+            if (sfd >= 0) {
+                sink += read(sfd, buffer, sizeof(buffer));
+                close(sfd);
+            }
+        }
+    }
+    bench_report("sysfs open/read/close", iterations, now_sec() - start);
+    
+    // Атрибут state: один pread() открытого дескриптора вместо трех файлов
+    start = now_sec();
+    for (i = 0; i < iterations; i++)
+        sink += read_sysfs_state(buffer, sizeof(buffer));
+    bench_report("sysfs state pread", iterations, now_sec() - start);
+    
+    munmap((void *)page, sizeof(*page));
     close(fd);
-    printf("Command executed: %s\n", command);
+    (void)sink;
+    return 0;
 }
 
-void write_sysfs(const char *path, const char *value)
+// Вывод изменений состояния по мере их появления, без опроса по таймеру
+static int run_watch(int count)
 {
-    FILE *fp = fopen(path, "w");
+    printf("Waiting for state changes (Ctrl+C to stop)...\n");
+    while (count != 0) {
+        struct vled_state st;
+        int retval = vled_wait(led, -1);
+        if (retval < 0) {
+            printf("wait failed: %s\n", strerror(-retval));
+            break;
+        }
+        if (retval == 0 || vled_get_state(led, &st) < 0)
+            continue;
+        printf("----\nLED State: %s\nBrightness: %u\nColor: %s\n",
+               st.led_state ? "ON" : "OFF", st.brightness, st.color);
+        fflush(stdout);
+        count--;
+    }
+    
+    return 0;
+}
+
+// Чтение состояния в выбранном формате буфером размера chunk: запись
+// собирается из нескольких read() одного снимка до конца файла
+static int run_read(const char *format_name, size_t chunk)
+{
+    static const char *const formats[] = {
+        [VLED_FORMAT_TEXT] = "text",
+        [VLED_FORMAT_KV] = "kv",
+        [VLED_FORMAT_JSON] = "json",
+        [VLED_FORMAT_BINARY] = "binary",
+    };
+    char record[256];
+    size_t total = 0;
+    __u32 format;
+    int reads = 0;
+    ssize_t n;
+    int fd;
+    
+    for (format = 0; format <= VLED_FORMAT_BINARY; format++)
+        if (strcmp(format_name, formats[format]) == 0)
+            break;
+    if (format > VLED_FORMAT_BINARY || chunk < 1 || chunk > sizeof(record)) {
+        printf("Usage: read [text|kv|json|binary] [chunk 1-%zu]\n", sizeof(record));
+        return 1;
+    }
+    
+    fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd < 0 || ioctl(fd, VLED_IOC_SET_READ_FORMAT, &format) < 0) {
+        printf("Error setting read format: %s\n", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    
+    while (total < sizeof(record)) {
+        size_t want = sizeof(record) - total;
+        
+        n = read(fd, record + total, want < chunk ? want : chunk);
+        if (n < 0)
+            printf("read failed: %s\n", strerror(errno));
+        if (n <= 0)
+            break;
+        total += n;
+        reads++;
+    }
+    close(fd);
+    
+    printf("%zu bytes in %d reads of up to %zu bytes\n", total, reads, chunk);
+    if (format == VLED_FORMAT_BINARY) {
+        struct vled_state_record rec;
+        if (total != sizeof(rec)) {
+            printf("Unexpected record size, %zu expected\n", sizeof(rec));
+            return 1;
+        }
+        memcpy(&rec, record, sizeof(rec));
+        printf("seq %u: state %u brightness %u color %s rgb %06x\n", rec.seq,
+               rec.state.led_state, rec.state.brightness, rec.state.color, rec.state.rgb);
+    } else {
+        fwrite(record, 1, total, stdout);
+    }
+    return 0;
+}
+
+// Асинхронные обновления: частые изменения яркости объединяются библиотекой
+static int run_async(int updates)
+{
+    struct vled_client_stats stats;
+    double start, elapsed;
+    int retval;
+    
+    printf("Async test: %d brightness updates\n", updates);
+    
+    start = now_sec();
+    for (int i = 0; i < updates; i++) {
+        struct vled_state st = { .mask = VLED_SET_BRIGHTNESS, .brightness = i % 256 };
+        vled_set_state_async(led, &st);
+    }
+    retval = vled_flush(led);
+    elapsed = now_sec() - start;
+    
+    vled_get_stats(led, &stats);
+    printf("Queued: %lu, sent to driver: %lu, %.3f s\n", stats.queued, stats.sent, elapsed);
+    if (retval < 0)
+        printf("Async error: %s\n", strerror(-retval));
+    print_state("Final state (last update wins)");
+    return retval < 0 ? 1 : 0;
+}
+
+// Конкурентные контроллеры без внешней блокировки: каждый поток
+// увеличивает яркость на 1 через чтение версии и условное изменение,
+// повторяя попытку при конфликте. Ни одно увеличение не должно потеряться.
+struct cas_worker {
+    pthread_t thread;
+    int increments;
+    unsigned long retries;
+    int errors;
+};
+
+static void *cas_worker_run(void *arg)
+{
+    struct cas_worker *w = arg;
+    int fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        w->errors++;
+        return NULL;
+    }
+    
+    for (int i = 0; i < w->increments; i++) {
+        struct vled_state_update upd = { 0 };
+        
+        // Пустая маска без условия - чтение состояния с версией
+        if (ioctl(fd, VLED_IOC_UPDATE_STATE, &upd) < 0) {
+            w->errors++;
+            break;
+        }
+        for (;;) {
+            upd.state.mask = VLED_SET_BRIGHTNESS;
+            upd.state.brightness = (upd.state.brightness + 1) % 256;
+            upd.flags = VLED_UPDATE_IF_SEQ;
+            upd.expected_seq = upd.seq;
+            if (ioctl(fd, VLED_IOC_UPDATE_STATE, &upd) == 0)
+                break;
+            if (errno != EAGAIN) {
+                w->errors++;
+                close(fd);
+                return NULL;
+            }
+            // upd содержит текущее состояние и версию
+            w->retries++;
+        }
+    }
+    
+    close(fd);
+    return NULL;
+}
+
+static int run_cas(int threads, int increments)
+{
+    struct vled_state_update upd = { .state = { .mask = VLED_SET_BRIGHTNESS } };
+    struct cas_worker *workers = calloc(threads, sizeof(*workers));
+    unsigned long retries = 0;
+    unsigned int expected;
+    int errors = 0, retval;
+    double start, elapsed;
+    
+    if (!workers)
+        return 1;
+    // Начальная яркость 0
+    retval = vled_update_state(led, &upd);
+    if (retval < 0) {
+        printf("VLED_IOC_UPDATE_STATE failed: %s\n", strerror(-retval));
+        free(workers);
+        return 1;
+    }
+    printf("Compare-and-set test: %d threads x %d increments\n", threads, increments);
+    
+    start = now_sec();
+    for (int i = 0; i < threads; i++) {
+        workers[i].increments = increments;
+        pthread_create(&workers[i].thread, NULL, cas_worker_run, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        retries += workers[i].retries;
+        errors += workers[i].errors;
+    }
+    elapsed = now_sec() - start;
+    
+    expected = (unsigned long)threads * increments % 256;
+    memset(&upd, 0, sizeof(upd));
+    vled_update_state(led, &upd);
+    printf("Updates: %ld (%.0f/s), retries after conflict: %lu\n",
+           (long)threads * increments, threads * increments / elapsed, retries);
+    printf("Final brightness %u, expected %u, version %u\n",
+           upd.state.brightness, expected, upd.seq);
+    free(workers);
+    return errors || upd.state.brightness != expected ? 1 : 0;
+}
+
+// Одновременное управление всеми светодиодами: поток t обслуживает
+// устройства с номерами t, t + threads, t + 2 * threads, ...
+struct multi_worker {
+    pthread_t thread;
+    int index;
+    int threads;
+    int num_devices;
+    int *fds;
+    unsigned long ops;
+    unsigned long mismatches;
+};
+
+static int read_num_devices(void)
+{
+    int count = 0;
+    FILE *fp = fopen(PARAM_NUM_DEVICES, "r");
     if (fp) {
-        fprintf(fp, "%s", value);
+        if (fscanf(fp, "%d", &count) != 1)
+            count = 0;
         fclose(fp);
-        printf("Sysfs write: %s = %s\n", path, value);
-    } else {
-        printf("Error writing to %s: %s\n", path, strerror(errno));
     }
+    return count;
 }
 
-int main()
+static void *multi_worker_run(void *arg)
 {
-    printf("Virtual LED Driver Test Program\n");
-    printf("===============================\n");
+    struct multi_worker *w = arg;
+    unsigned int round = 0;
     
-    // Проверка существования драйвера
-    if (access(DEVICE_PATH, F_OK) != 0) {
-        printf("ERROR: Driver not loaded!\n");
-        printf("Please load the driver first:\n");
-        printf("  sudo insmod virtual_led_driver.ko\n");
+    while (!atomic_load_explicit(&stress_stop, memory_order_relaxed)) {
+        for (int dev = w->index; dev < w->num_devices; dev += w->threads) {
+            struct vled_state st = { .mask = VLED_SET_ALL };
+            st.brightness = (round + dev) % 256;
+            st.led_state = st.brightness & 1;
+            strcpy(st.color, stress_color(st.brightness));
+            if (ioctl(w->fds[dev], VLED_IOC_SET_STATE, &st) == 0)
+                w->ops++;
+        }
+        round++;
+    }
+    
+    // Каждое устройство должно хранить последнее записанное этим потоком
+    if (round-- == 0)
+        return NULL;
+    for (int dev = w->index; dev < w->num_devices; dev += w->threads) {
+        struct vled_state st;
+        if (ioctl(w->fds[dev], VLED_IOC_GET_STATE, &st) < 0 ||
+            st.brightness != (round + dev) % 256 ||
+            !stress_consistent(st.led_state, st.brightness, st.color))
+            w->mismatches++;
+    }
+    return NULL;
+}
+
+static int run_multi(int threads, int seconds)
+{
+    int num_devices = read_num_devices();
+    unsigned long ops = 0, mismatches = 0;
+    double start, elapsed;
+    char path[64];
+    int i;
+    
+    if (num_devices < 1) {
+        printf("Cannot read %s\n", PARAM_NUM_DEVICES);
+        return 1;
+    }
+    if (threads > num_devices)
+        threads = num_devices;
+    
+    int *fds = calloc(num_devices, sizeof(*fds));
+    struct multi_worker *workers = calloc(threads, sizeof(*workers));
+    if (!fds || !workers) {
+        free(fds);
+        free(workers);
+        return 1;
+    }
+    
+    for (i = 0; i < num_devices; i++) {
+        snprintf(path, sizeof(path), DEVICE_PATH_FMT, i);
+        fds[i] = open(path, O_RDWR);
+        if (fds[i] < 0) {
+            printf("Error opening %s: %s\n", path, strerror(errno));
+            while (i--)
+                close(fds[i]);
+            free(fds);
+            free(workers);
+            return 1;
+        }
+    }
+    
+    printf("Multi-device test: %d devices, %d threads, %d s\n", num_devices, threads, seconds);
+    
+    start = now_sec();
+    for (i = 0; i < threads; i++) {
+        workers[i].index = i;
+        workers[i].threads = threads;
+        workers[i].num_devices = num_devices;
+        workers[i].fds = fds;
+        pthread_create(&workers[i].thread, NULL, multi_worker_run, &workers[i]);
+    }
+    
+    sleep(seconds);
+    atomic_store(&stress_stop, 1);
+    
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+        mismatches += workers[i].mismatches;
+    }
+    elapsed = now_sec() - start;
+    
+    printf("Updates: %lu (%.0f/s)\n", ops, ops / elapsed);
+    printf("Devices with unexpected final state: %lu\n", mismatches);
+    
+    for (i = 0; i < num_devices; i++)
+        close(fds[i]);
+    free(fds);
+    free(workers);
+    return mismatches ? 1 : 0;
+}
+
+// Пропускная способность пакетных обновлений при разном размере кадра
+static int run_frame_bench(int seconds)
+{
+    static const int frame_sizes[] = { 1, 64, 1024 };
+    int num_devices = read_num_devices();
+    struct vled_led_update *updates;
+    
+    if (num_devices < 1) {
+        printf("Cannot read %s\n", PARAM_NUM_DEVICES);
+        return 1;
+    }
+    
+    updates = calloc(1024, sizeof(*updates));
+    if (!updates)
+        return 1;
+    
+    printf("Frame benchmark: %d devices, %d s per frame size\n", num_devices, seconds);
+    if (num_devices < 1024)
+        printf("Note: frames larger than %d update some LEDs more than once\n", num_devices);
+    
+    for (size_t k = 0; k < sizeof(frame_sizes) / sizeof(frame_sizes[0]); k++) {
+        int size = frame_sizes[k];
+        unsigned long frames = 0;
+        unsigned int round = 0;
+        double start = now_sec(), elapsed = 0;
+        
+        do {
+            for (int i = 0; i < size; i++) {
+                updates[i].index = i % num_devices;
+                updates[i].state.mask = VLED_SET_ALL;
+                updates[i].state.brightness = (round + i) % 256;
+                updates[i].state.led_state = updates[i].state.brightness & 1;
+                strcpy(updates[i].state.color, stress_color(updates[i].state.brightness));
+            }
+            int retval = vled_set_frame(led, updates, size);
+            if (retval < 0) {
+                printf("SET_FRAME failed: %s\n", strerror(-retval));
+                free(updates);
+                return 1;
+            }
+            frames++;
+            round++;
+            elapsed = now_sec() - start;
+        } while (elapsed < seconds);
+        
+        printf("%5d LEDs/frame: %10.0f frames/s %12.0f updates/s\n",
+               size, frames / elapsed, frames * size / elapsed);
+    }
+    
+    free(updates);
+    return 0;
+}
+
+// Вывод журнала переходов из /dev/vled0_events
+static int run_events(int follow)
+{
+    static const char *sources[] = { "chardev", "sysfs", "ioctl", "effect", "ledclass" };
+    struct vled_event events[64];
+    __u64 lost = 0;
+    
+    int fd = open(EVENTS_PATH, O_RDONLY | (follow ? 0 : O_NONBLOCK));
+    if (fd < 0) {
+        printf("Error opening %s: %s\n", EVENTS_PATH, strerror(errno));
+        return 1;
+    }
+    
+    for (;;) {
+        ssize_t bytes = read(fd, events, sizeof(events));
+        if (bytes <= 0)
+            break;
+        for (size_t i = 0; i < bytes / sizeof(events[0]); i++) {
+            const struct vled_event *ev = &events[i];
+            const char *field = ev->field == VLED_SET_LED_STATE ? "state" :
+                                ev->field == VLED_SET_BRIGHTNESS ? "brightness" : "color";
+            char values[32];
+            // Для цвета значения - RGB
+            if (ev->field == VLED_SET_COLOR)
+                snprintf(values, sizeof(values), "#%06x -> #%06x", ev->old_value, ev->new_value);
+            else
+                snprintf(values, sizeof(values), "%u -> %u", ev->old_value, ev->new_value);
+            printf("%llu.%09llu #%llu pid %u %-7s %-10s %s\n",
+                   (unsigned long long)(ev->timestamp_ns / 1000000000ULL),
+                   (unsigned long long)(ev->timestamp_ns % 1000000000ULL),
+                   (unsigned long long)ev->seq, ev->pid,
+                   ev->source < 5 ? sources[ev->source] : "?",
+                   field, values);
+        }
+        fflush(stdout);
+    }
+    
+    if (ioctl(fd, VLED_IOC_EVENTS_LOST, &lost) == 0 && lost)
+        printf("Lost events: %llu\n", (unsigned long long)lost);
+    close(fd);
+    return 0;
+}
+
+// Набор нагрузочных тестов: потоки выполняют смесь операций через разные
+// интерфейсы драйвера с максимальной скоростью (замкнутый цикл) или с
+// заданной общей частотой. Задержка при заданной частоте считается от
+// запланированного момента операции, поэтому отставание не скрывается.
+enum bench_op {
+    BENCH_WRITE,                // Текстовая команда в /dev/vledN
+    BENCH_READ,                 // Чтение состояния из /dev/vledN
+    BENCH_SYSFS_WRITE,          // Запись атрибута brightness
+    BENCH_SYSFS_READ,           // Чтение атрибута brightness
+    BENCH_IOCTL_SET,            // VLED_IOC_SET_STATE
+    BENCH_IOCTL_GET,            // VLED_IOC_GET_STATE
+    BENCH_MMAP,                 // Чтение страницы состояния
+    BENCH_OP_COUNT,
+};
+
+static const char *bench_op_names[BENCH_OP_COUNT] = {
+    [BENCH_WRITE]       = "write",
+    [BENCH_READ]        = "read",
+    [BENCH_SYSFS_WRITE] = "sysfs-write",
+    [BENCH_SYSFS_READ]  = "sysfs-read",
+    [BENCH_IOCTL_SET]   = "ioctl-set",
+    [BENCH_IOCTL_GET]   = "ioctl-get",
+    [BENCH_MMAP]        = "mmap",
+};
+
+#define BENCH_DEFAULT_MIX "write=25,read=25,ioctl-set=25,ioctl-get=25"
+
+enum bench_format { BENCH_HUMAN, BENCH_CSV, BENCH_JSON };
+
+// Гистограмма задержек: до 64 нс точно, дальше 64 корзины на каждую
+// степень двойки (погрешность перцентилей меньше 2%)
+#define BENCH_SUB_BITS 6
+#define BENCH_SUB (1 << BENCH_SUB_BITS)
+#define BENCH_BUCKETS (BENCH_SUB + (40 - BENCH_SUB_BITS) * BENCH_SUB)
+
+struct bench_hist {
+    unsigned long count;
+    unsigned long errors;
+    __u64 max_ns;
+    unsigned long buckets[BENCH_BUCKETS];
+};
+
+struct bench_config {
+    unsigned int device;
+    int threads;
+    int seconds;
+    double rate;                // Операций в секунду на все потоки, 0 - без ограничения
+    unsigned int weights[BENCH_OP_COUNT];
+    unsigned int weight_total;
+    enum bench_format format;
+};
+
+struct bench_worker {
+    pthread_t thread;
+    int index;
+    const struct bench_config *config;
+    __u64 start_ns, end_ns;
+    int fd;
+    int sysfs_fd;
+    const struct vled_shared_page *page;
+    struct bench_hist hist[BENCH_OP_COUNT];
+};
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int bench_bucket(__u64 ns)
+{
+    unsigned int exp, bucket;
+    
+    if (ns < BENCH_SUB)
+        return ns;
+    exp = 63 - __builtin_clzll(ns);
+    bucket = BENCH_SUB + (exp - BENCH_SUB_BITS) * BENCH_SUB +
+             ((ns >> (exp - BENCH_SUB_BITS)) & (BENCH_SUB - 1));
+    return bucket < BENCH_BUCKETS ? bucket : BENCH_BUCKETS - 1;
+}
+
+// Середина интервала корзины
+static __u64 bench_bucket_value(unsigned int bucket)
+{
+    unsigned int shift;
+    
+    if (bucket < BENCH_SUB)
+        return bucket;
+    shift = (bucket - BENCH_SUB) / BENCH_SUB;
+    return ((__u64)(BENCH_SUB + (bucket - BENCH_SUB) % BENCH_SUB) << shift) + ((1ULL << shift) >> 1);
+}
+
+static __u64 bench_percentile(const struct bench_hist *h, double p)
+{
+    unsigned long rank = (unsigned long)(p * h->count), seen = 0;
+    
+    if (!h->count)
+        return 0;
+    if (rank >= h->count)
+        rank = h->count - 1;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank)
+            return bench_bucket_value(i) < h->max_ns ? bench_bucket_value(i) : h->max_ns;
+    }
+    return h->max_ns;
+}
+
+static void bench_hist_merge(struct bench_hist *dst, const struct bench_hist *src)
+{
+    dst->count += src->count;
+    dst->errors += src->errors;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+// Одна операция; 0 - успех
+static int bench_do_op(struct bench_worker *w, enum bench_op op, unsigned int value)
+{
+    struct vled_state st = { .mask = VLED_SET_BRIGHTNESS, .brightness = value };
+    char buffer[256];
+    int len;
+    
+    switch (op) {
+    case BENCH_WRITE:
+        len = snprintf(buffer, sizeof(buffer), "BRIGHTNESS %u\n", value);
+        return write(w->fd, buffer, len) == len ? 0 : -1;
+    case BENCH_READ:
+        return pread(w->fd, buffer, sizeof(buffer), 0) < 0 ? -1 : 0;
+    case BENCH_SYSFS_WRITE:
+        len = snprintf(buffer, sizeof(buffer), "%u\n", value);
+        return pwrite(w->sysfs_fd, buffer, len, 0) == len ? 0 : -1;
+    case BENCH_SYSFS_READ:
+        return pread(w->sysfs_fd, buffer, sizeof(buffer), 0) < 0 ? -1 : 0;
+    case BENCH_IOCTL_SET:
+        return ioctl(w->fd, VLED_IOC_SET_STATE, &st);
+    case BENCH_IOCTL_GET:
+        return ioctl(w->fd, VLED_IOC_GET_STATE, &st);
+    case BENCH_MMAP:
+        vled_shared_read(w->page, &st, NULL);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static void *bench_worker_run(void *arg)
+{
+    struct bench_worker *w = arg;
+    const struct bench_config *c = w->config;
+    __u64 interval = c->rate > 0 ? (__u64)(c->threads * 1e9 / c->rate) : 0;
+    __u64 next = w->start_ns + (interval * w->index) / c->threads;
+    unsigned int rng = 2463534242U + w->index;
+    
+    for (unsigned int i = 0;; i++) {
+        __u64 t0, t1;
+        
+        if (interval) {
+            struct timespec ts = { next / 1000000000ULL, next % 1000000000ULL };
+            if (next >= w->end_ns)
+                break;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            t0 = next;
+            next += interval;
+        } else {
+            t0 = now_ns();
+            if (t0 >= w->end_ns)
+                break;
+        }
+        
+        // Выбор операции по весам смеси (xorshift32)
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        unsigned int pick = rng % c->weight_total;
+        enum bench_op op = 0;
+        while (pick >= c->weights[op])
+            pick -= c->weights[op++];
+        
+        int retval = bench_do_op(w, op, i % 256);
+        t1 = now_ns();
+        
+        struct bench_hist *h = &w->hist[op];
+        h->count++;
+        if (retval)
+            h->errors++;
+        h->buckets[bench_bucket(t1 - t0)]++;
+        if (t1 - t0 > h->max_ns)
+            h->max_ns = t1 - t0;
+    }
+    return NULL;
+}
+
+// Смесь вида "write=50,ioctl-get=50" или "all"; 0 при успехе
+static int bench_parse_mix(struct bench_config *c, const char *mix)
+{
+    char *copy, *tok, *save = NULL;
+    
+    memset(c->weights, 0, sizeof(c->weights));
+    c->weight_total = 0;
+    if (strcmp(mix, "all") == 0) {
+        for (int op = 0; op < BENCH_OP_COUNT; op++)
+            c->weights[op] = 1;
+        c->weight_total = BENCH_OP_COUNT;
+        return 0;
+    }
+    
+    copy = strdup(mix);
+    if (!copy)
+        return -1;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        unsigned int weight = eq ? (unsigned int)atoi(eq + 1) : 1;
+        int op;
+        
+        if (eq)
+            *eq = '\0';
+        for (op = 0; op < BENCH_OP_COUNT; op++)
+            if (strcmp(tok, bench_op_names[op]) == 0)
+                break;
+        if (op == BENCH_OP_COUNT) {
+            fprintf(stderr, "Unknown operation '%s'\n", tok);
+            free(copy);
+            return -1;
+        }
+        c->weights[op] += weight;
+        c->weight_total += weight;
+    }
+    free(copy);
+    return c->weight_total ? 0 : -1;
+}
+
+static int bench_open(struct bench_worker *w, const struct bench_config *c)
+{
+    const unsigned int *wt = c->weights;
+    char path[64];
+    
+    snprintf(path, sizeof(path), DEVICE_PATH_FMT, c->device);
+    w->fd = open(path, (wt[BENCH_WRITE] || wt[BENCH_IOCTL_SET]) ? O_RDWR : O_RDONLY);
+    if (w->fd < 0) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    w->sysfs_fd = -1;
+    if (wt[BENCH_SYSFS_WRITE] || wt[BENCH_SYSFS_READ]) {
+        const char *attr = sysfs_attr_path(0, c->device, "brightness");
+        
+        w->sysfs_fd = open(attr, wt[BENCH_SYSFS_WRITE] ? O_RDWR : O_RDONLY);
+        if (w->sysfs_fd < 0) {
+            fprintf(stderr, "Error opening %s: %s\n", attr, strerror(errno));
+            return -1;
+        }
+    }
+    
+    if (wt[BENCH_MMAP]) {
+        void *page = mmap(NULL, sizeof(*w->page), PROT_READ, MAP_SHARED, w->fd, 0);
+        if (page == MAP_FAILED) {
+            fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+            return -1;
+        }
+        w->page = page;
+    }
+    return 0;
+}
+
+static void bench_close(struct bench_worker *w)
+{
+    if (w->page)
+        munmap((void *)w->page, sizeof(*w->page));
+    if (w->sysfs_fd >= 0)
+        close(w->sysfs_fd);
+    if (w->fd >= 0)
+        close(w->fd);
+}
+
+static void bench_print_row(const struct bench_config *c, const char *kernel, const char *name,
+                            const struct bench_hist *h, double elapsed, int first)
+{
+    __u64 p50 = bench_percentile(h, 0.50);
+    __u64 p99 = bench_percentile(h, 0.99);
+    __u64 p999 = bench_percentile(h, 0.999);
+    
+    switch (c->format) {
+    case BENCH_HUMAN:
+        printf("%-12s %10lu %12.0f %10.2f %10.2f %10.2f %10.2f %8lu\n",
+               name, h->count, h->count / elapsed, p50 / 1e3, p99 / 1e3, p999 / 1e3,
+               h->max_ns / 1e3, h->errors);
+        break;
+    case BENCH_CSV:
+        printf("%s,%d,%.0f,%s,%lu,%.1f,%llu,%llu,%llu,%llu,%lu\n",
+               kernel, c->threads, c->rate, name, h->count, h->count / elapsed,
+               (unsigned long long)p50, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)h->max_ns, h->errors);
+        break;
+    case BENCH_JSON:
+        printf("%s\n    {\"op\": \"%s\", \"ops\": %lu, \"ops_per_sec\": %.1f, "
+               "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+               "\"max_ns\": %llu, \"errors\": %lu}",
+               first ? "" : ",", name, h->count, h->count / elapsed,
+               (unsigned long long)p50, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)h->max_ns, h->errors);
+        break;
+    }
+}
+
+static void bench_usage(const char *prog)
+{
+    printf("Usage: %s bench [-t threads] [-d seconds] [-r ops_per_sec] [-m mix]\n"
+           "                [-o human|csv|json] [-D device]\n"
+           "  -r 0 (default) runs a closed loop at maximum throughput\n"
+           "  mix: comma-separated op=weight or 'all', default " BENCH_DEFAULT_MIX "\n"
+           "  ops:", prog);
+    for (int op = 0; op < BENCH_OP_COUNT; op++)
+        printf(" %s", bench_op_names[op]);
+    printf("\n");
+}
+
+static int run_bench(int argc, char *argv[], const char *prog)
+{
+    struct bench_config c = { .threads = 1, .seconds = 5, .format = BENCH_HUMAN };
+    const char *mix = BENCH_DEFAULT_MIX;
+    struct bench_hist total = { 0 };
+    struct bench_worker *workers;
+    struct utsname uts;
+    unsigned long errors = 0;
+    double elapsed;
+    int opt, retval = 0, started = 0;
+    
+    optind = 1;
+    while ((opt = getopt(argc, argv, "t:d:r:m:o:D:")) != -1) {
+        switch (opt) {
+        case 't': c.threads = atoi(optarg); break;
+        case 'd': c.seconds = atoi(optarg); break;
+        case 'r': c.rate = atof(optarg); break;
+        case 'm': mix = optarg; break;
+        case 'D': c.device = atoi(optarg); break;
+        case 'o':
+            if (strcmp(optarg, "human") == 0)
+                c.format = BENCH_HUMAN;
+            else if (strcmp(optarg, "csv") == 0)
+                c.format = BENCH_CSV;
+            else if (strcmp(optarg, "json") == 0)
+                c.format = BENCH_JSON;
+            else
+                c.threads = 0;
+            break;
+        default:
+            c.threads = 0;
+        }
+    }
+    if (c.threads < 1 || c.seconds < 1 || c.rate < 0 || bench_parse_mix(&c, mix)) {
+        bench_usage(prog);
+        return 1;
+    }
+    
+    workers = calloc(c.threads, sizeof(*workers));
+    if (!workers)
         return 1;
+    for (int i = 0; i < c.threads; i++)
+        workers[i].fd = workers[i].sysfs_fd = -1;
+    for (int i = 0; i < c.threads; i++) {
+        if (bench_open(&workers[i], &c)) {
+            retval = 1;
+            goto out;
+        }
+    }
+    
+    __u64 start = now_ns();
+    for (int i = 0; i < c.threads; i++) {
+        workers[i].index = i;
+        workers[i].config = &c;
+        workers[i].start_ns = start;
+        workers[i].end_ns = start + (__u64)c.seconds * 1000000000ULL;
+        if (pthread_create(&workers[i].thread, NULL, bench_worker_run, &workers[i]))
+            break;
+        started++;
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+    elapsed = (now_ns() - start) / 1e9;
+    
+    if (uname(&uts))
+        strcpy(uts.release, "unknown");
+    
+    switch (c.format) {
+    case BENCH_HUMAN:
+        printf("Benchmark: vled%u, kernel %s, %d threads, %d s, %s, mix %s\n",
+               c.device, uts.release, c.threads, c.seconds,
+               c.rate > 0 ? "open loop" : "closed loop", mix);
+        if (c.rate > 0)
+            printf("Target rate: %.0f ops/s\n", c.rate);
+        printf("%-12s %10s %12s %10s %10s %10s %10s %8s\n",
+               "op", "ops", "ops/s", "p50 us", "p99 us", "p99.9 us", "max us", "errors");
+        break;
+    case BENCH_CSV:
+        printf("kernel,threads,target_rate,op,ops,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns,errors\n");
+        break;
+    case BENCH_JSON:
+        printf("{\n  \"device\": %u, \"kernel\": \"%s\", \"threads\": %d, \"duration_s\": %.3f, "
+               "\"target_rate\": %.0f, \"mix\": \"%s\",\n  \"results\": [",
+               c.device, uts.release, c.threads, elapsed, c.rate, mix);
+        break;
+    }
+    
+    int first = 1;
+    for (int op = 0; op < BENCH_OP_COUNT; op++) {
+        struct bench_hist h = { 0 };
+        if (!c.weights[op])
+            continue;
+        for (int i = 0; i < started; i++)
+            bench_hist_merge(&h, &workers[i].hist[op]);
+        bench_hist_merge(&total, &h);
+        bench_print_row(&c, uts.release, bench_op_names[op], &h, elapsed, first);
+        first = 0;
+    }
+    bench_print_row(&c, uts.release, "total", &total, elapsed, first);
+    if (c.format == BENCH_JSON)
+        printf("\n  ]\n}\n");
+    errors = total.errors;
+    
+out:
+    for (int i = 0; i < c.threads; i++)
+        bench_close(&workers[i]);
+    free(workers);
+    return retval || errors || started < c.threads ? 1 : 0;
+}
+
+static int run_tests(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return run_bench(argc - 1, argv + 1, argv[0]);
+    
+    if (argc > 1 && strcmp(argv[1], "stress") == 0) {
+        int readers = argc > 2 ? atoi(argv[2]) : 4;
+        int writers = argc > 3 ? atoi(argv[3]) : 1;
+        int seconds = argc > 4 ? atoi(argv[4]) : 5;
+        if (readers < 1 || writers < 1 || seconds < 1) {
+            printf("Usage: %s stress [readers] [writers] [seconds]\n", argv[0]);
+            return 1;
+        }
+        return run_stress(readers, writers, seconds);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "pollbench") == 0) {
+        long iterations = argc > 2 ? atol(argv[2]) : 100000;
+        if (iterations < 1) {
+            printf("Usage: %s pollbench [iterations]\n", argv[0]);
+            return 1;
+        }
+        return run_poll_bench(iterations);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "multi") == 0) {
+        int threads = argc > 2 ? atoi(argv[2]) : 4;
+        int seconds = argc > 3 ? atoi(argv[3]) : 5;
+        if (threads < 1 || seconds < 1) {
+            printf("Usage: %s multi [threads] [seconds]\n", argv[0]);
+            return 1;
+        }
+        return run_multi(threads, seconds);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "cas") == 0) {
+        int threads = argc > 2 ? atoi(argv[2]) : 4;
+        int increments = argc > 3 ? atoi(argv[3]) : 10000;
+        if (threads < 1 || increments < 1) {
+            printf("Usage: %s cas [threads] [increments]\n", argv[0]);
+            return 1;
+        }
+        return run_cas(threads, increments);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "framebench") == 0) {
+        int seconds = argc > 2 ? atoi(argv[2]) : 3;
+        if (seconds < 1) {
+            printf("Usage: %s framebench [seconds]\n", argv[0]);
+            return 1;
+        }
+        return run_frame_bench(seconds);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "events") == 0)
+        return run_events(argc > 2 && strcmp(argv[2], "-f") == 0);
+    
+    if (argc > 1 && strcmp(argv[1], "read") == 0)
+        return run_read(argc > 2 ? argv[2] : "text", argc > 3 ? (size_t)atol(argv[3]) : 256);
+    
+    if (argc > 1 && strcmp(argv[1], "watch") == 0)
+        return run_watch(argc > 2 ? atoi(argv[2]) : -1);
+    
+    if (argc > 1 && strcmp(argv[1], "async") == 0) {
+        int updates = argc > 2 ? atoi(argv[2]) : 100000;
+        if (updates < 1) {
+            printf("Usage: %s async [updates]\n", argv[0]);
+            return 1;
+        }
+        return run_async(updates);
     }
     
     printf("Driver found. Starting tests...\n");
@@ -98,51 +1314,110 @@ int main()
     
     // Тест 2: Включение через устройство
     printf("\n\n2. Turning LED ON via device");
-    write_command("ON");
-    sleep(1);
+    set_led(1);
+    expect_state(1, -1, -1);
     print_state("After turning ON");
     
     // Тест 3: Изменение яркости через устройство
     printf("\n\n3. Setting brightness to 200 via device");
-    write_command("BRIGHTNESS 200");
-    sleep(1);
+    set_brightness(200);
+    expect_state(1, 200, -1);
     print_state("After brightness change");
     
     // Тест 4: Изменение цвета через устройство
     printf("\n\n4. Setting color to blue via device");
-    write_command("COLOR blue");
-    sleep(1);
+    set_color("blue");
+    expect_state(1, 200, 0x0000ff);
     print_state("After color change");
     
     // Тест 5: Выключение через sysfs
     printf("\n\n5. Turning LED OFF via sysfs");
     write_sysfs(SYSFS_STATE, "0");
-    sleep(1);
+    expect_state(0, 200, 0x0000ff);
     print_state("After turning OFF via sysfs");
     
     // Тест 6: Изменение яркости через sysfs
     printf("\n\n6. Setting brightness to 100 via sysfs");
     write_sysfs(SYSFS_BRIGHTNESS, "100");
-    sleep(1);
+    expect_state(0, 100, 0x0000ff);
     print_state("After sysfs brightness change");
     
     // Тест 7: Изменение цвета через sysfs
     printf("\n\n7. Setting color to red via sysfs");
     write_sysfs(SYSFS_COLOR, "red");
-    sleep(1);
+    expect_state(0, 100, 0xff0000);
     print_state("After sysfs color change");
     
-    // Тест 8: Включение через устройство
-    printf("\n\n8. Turning LED ON via device again");
+    // Тест 8: Включение через текстовую команду (совместимость)
+    printf("\n\n8. Turning LED ON via text command");
     write_command("ON");
-    sleep(1);
+    expect_state(1, 100, 0xff0000);
+    print_state("After text command");
+    
+    // Тест 9: Несколько команд одной записью
+    printf("\n\n9. Sending three commands in one write");
+    write_command("OFF\nBRIGHTNESS 10\nCOLOR green\n");
+    expect_write_status(3, 0);
+    expect_state(0, 10, 0x00ff00);
     print_state("Final state");
     
+    if (check_failures) {
+        printf("\n\n%d checks failed\n", check_failures);
+        return 1;
+    }
     printf("\n\nAll tests completed successfully!\n");
     printf("\nYou can also test manually:\n");
-    printf("  echo 'ON' > /dev/vled\n");
-    printf("  echo '1' > /sys/class/vled/vled/led_state\n");
-    printf("  cat /dev/vled\n");
+    printf("  echo 'ON' > /dev/vled0\n");
+    printf("  echo 'COLOR #ff8000' > /dev/vled0\n");
+    printf("  printf 'ON\\nBRIGHTNESS 10\\nCOLOR red\\n' > /dev/vled0\n");
+    printf("  echo 00ff80 > /sys/class/vled/vled0/rgb\n");
+    printf("  echo '1' > /sys/class/vled/vled0/led_state\n");
+    printf("  cat /dev/vled0\n");
+    printf("  cat /sys/class/vled/vled0/state\n");
+    printf("  echo 'EFFECT blink 500 500' > /dev/vled0\n");
+    printf("  echo 'breathe 10 255 3000' > /sys/class/vled/vled0/effect\n");
+    printf("  echo 'pattern repeat 200:1:255 200:0:0 600:1:64' > /sys/class/vled/vled0/effect\n");
+    printf("  ./test_control stress 8 2 10   # readers writers seconds\n");
+    printf("  ./test_control pollbench 100000\n");
+    printf("  ./test_control watch [count]\n");
+    printf("  ./test_control read json 8   # format, bytes per read()\n");
+    printf("  ./test_control events [-f]\n");
+    printf("  ./test_control multi [threads] [seconds]\n");
+    printf("  ./test_control framebench [seconds]\n");
+    printf("  ./test_control async [updates]\n");
+    printf("  ./test_control cas [threads] [increments]\n");
+    printf("  ./test_control bench -t 4 -d 10 -m all -o json\n");
     
     return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int retval;
+    
+    // В режиме bench stdout содержит только результаты (CSV/JSON)
+    if (argc < 2 || strcmp(argv[1], "bench") != 0) {
+        printf("Virtual LED Driver Test Program\n");
+        printf("===============================\n");
+    }
+    
+    // Проверка существования драйвера
+    if (access(DEVICE_PATH, F_OK) != 0) {
+        printf("ERROR: Driver not loaded!\n");
+        printf("Please load the driver first:\n");
+        printf("  sudo insmod virtual_led_driver.ko\n");
+        return 1;
+    }
+    
+    led = vled_open(0);
+    if (!led) {
+        printf("Error opening device: %s\n", strerror(errno));
+        return 1;
+    }
+    
+    retval = run_tests(argc, argv);
+    vled_close(led);
+    if (sysfs_state_fd >= 0)
+        close(sysfs_state_fd);
+    return retval;
 }
\ No newline at end of file
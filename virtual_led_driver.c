@@ -8,158 +8,1678 @@
 #include <linux/uaccess.h>
 #include <linux/string.h>
 #include <linux/version.h>
+#include <linux/seqlock.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/cache.h>
+#include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
+#include <linux/leds.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
+#include <linux/log2.h>
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+#include <linux/led-class-multicolor.h>
+#endif
+
+#include "vled_ioctl.h"
+#include "vled_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "vled_trace.h"
 
 #define DRIVER_NAME "virtual_led"
 #define DEVICE_NAME "vled"
 #define CLASS_NAME "vled"
-#define MAX_DEVICES 1
+#define EVENTS_SUFFIX "_events"
+#define MAX_DEVICES 32768              // Верхняя граница параметра num_devices
+#define VLED_EVENTS_SIZE 256           // Размер журнала событий, степень двойки
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Alexander Shelestov");
 MODULE_DESCRIPTION("Virtual USB LED Driver with GUI control");
 MODULE_VERSION("2.2");
 
+static unsigned int num_devices = 1;
+module_param(num_devices, uint, 0444);
+MODULE_PARM_DESC(num_devices, "Number of virtual LEDs (/dev/vledN), default 1");
+
+static bool led_class;
+module_param(led_class, bool, 0444);
+MODULE_PARM_DESC(led_class, "Also register each LED with the kernel LED subsystem (/sys/class/leds)");
+
+static bool log_commands;
+module_param(log_commands, bool, 0644);
+MODULE_PARM_DESC(log_commands, "Log every command to the kernel log (rate-limited), default off; use the vled tracepoints instead");
+
+static bool vled_stats_enabled = true;
+module_param_named(stats, vled_stats_enabled, bool, 0444);
+MODULE_PARM_DESC(stats, "Collect per-CPU counters and latency histograms in debugfs, default on");
+
 static int major_number;
 static struct class *vled_class = NULL;
-static struct device *vled_device = NULL;
+
+// Один cdev на все младшие номера каждого типа узла: [0, num_devices) для
+// vledN и [num_devices, 2 * num_devices) для vledN_events. Устройство
+// находится по iminor() за O(1), без отдельного cdev_add на каждый светодиод.
 static struct cdev vled_cdev;
+static struct cdev vled_events_cdev;
+
+// Счетчики статистики
+enum vled_stat {
+    VLED_STAT_OPENS,
+    VLED_STAT_READS,
+    VLED_STAT_WRITES,
+    VLED_STAT_IOCTLS,
+    VLED_STAT_REJECTED,     // Нераспознанные или неверные команды
+    VLED_STAT_CONTENDED,    // Мьютекс устройства был занят
+    VLED_STAT_COUNT,
+};
+
+// Гистограммы задержек
+enum vled_hist {
+    VLED_HIST_WRITE,        // Разбор и применение команды
+    VLED_HIST_LOCK_WAIT,    // Ожидание мьютекса устройства
+    VLED_HIST_SNAPSHOT,     // Чтение согласованного снимка
+    VLED_HIST_COUNT,
+};
 
-// Структура состояния устройства
+// Корзина k содержит задержки [2^(k-1), 2^k) нс, последняя - все большие
+#define VLED_HIST_BUCKETS 32
+
+// Статистика одного светодиода на одном CPU, обновляется без атомарных операций
+struct vled_stats {
+    u64 counters[VLED_STAT_COUNT];
+    u64 hist[VLED_HIST_COUNT][VLED_HIST_BUCKETS];
+};
+
+// Структура состояния устройства, общая для всех открытых дескрипторов и sysfs.
+// Выровнена по кэш-линии, чтобы соседние светодиоды в массиве не делили линии.
 struct vled_device_data {
-    int led_state;          // 0 - выключен, 1 - включен
-    int brightness;         // Яркость 0-255
-    char color[16];         // Цвет светодиода
-    struct mutex lock;      // Мьютекс для синхронизации
+    union vled_packed state; // Состояние, меняется только через vled_store()
+    struct mutex lock;      // Мьютекс для синхронизации писателей
+    seqcount_mutex_t seq;   // Счетчик версий для читателей без блокировки
+    struct device *dev;     // Устройство в sysfs
+    struct vled_shared_page *shared; // Страница состояния для mmap()
+    wait_queue_head_t wq;   // Ожидающие изменения состояния
+    atomic_long_t events_head;          // Номер следующей записи журнала
+    struct vled_event_slot *events;     // Кольцевой журнал переходов
+    struct device *events_dev;          // Узел /dev/vledN_events
+    u32 frame_changed;      // Поля, измененные текущим кадром (под vled_frame_lock)
+    struct vled_effect effect;          // Текущий эффект (под lock)
+    ktime_t effect_start;               // Начало эффекта, от него считаются все шаги
+    struct hrtimer effect_timer;        // Срабатывает в момент следующего шага
+    struct work_struct effect_work;     // Применение шага в контексте процесса
+    struct mutex effect_lock;           // Сериализует запуск и остановку эффектов
+    struct vled_stats __percpu *stats;  // NULL, если статистика отключена
+    struct dentry *debugfs;             // Каталог vled/vledN в debugfs
+#if IS_ENABLED(CONFIG_LEDS_CLASS)
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+    struct led_classdev_mc led_mc;      // Многоцветный светодиод в /sys/class/leds
+    struct mc_subled led_subleds[3];    // Каналы R, G, B
+#else
+    struct led_classdev led_cdev;       // Светодиод в /sys/class/leds
+#endif
+    char led_name[32];
+    bool led_registered;
+    bool led_hw_blink;                  // Мигание запущено через blink_set (под effect_lock)
+#endif
+} ____cacheline_aligned_in_smp;
+
+// Слот журнала: pos = номер записи + 1 после публикации, 0 - запись идет
+struct vled_event_slot {
+    unsigned long pos;
+    struct vled_event ev;
+};
+
+// Читатель /dev/vled_events
+struct vled_event_reader {
+    struct vled_device_data *dev;
+    unsigned long pos;      // Номер следующей записи для чтения
+    u64 lost;               // Записи, перезаписанные до прочтения
+    struct mutex lock;
+};
+
+// Состояние дескриптора, создается только по запросу (poll, режим или
+// формат чтения, чтение частями, хвост команды или ошибки записи)
+struct vled_session {
+    unsigned int seen_seq;  // Версия состояния, последняя отданная читателю
+    u32 read_mode;          // VLED_READ_SNAPSHOT или VLED_READ_WAIT
+    struct mutex write_lock;            // Сериализует write() одного дескриптора
+    struct vled_cmd_stream stream;      // Незавершенная команда между записями
+    struct vled_write_status write_status; // Итог последнего write()
+    u32 read_format;                    // VLED_FORMAT_*
+    struct mutex read_lock;             // Защищает буфер записи read()
+    u32 read_len;                       // Длина записи в read_buf
+    u32 read_pos;                       // Прочитано в режиме VLED_READ_WAIT
+    char read_buf[VLED_READ_MAX];       // Запись, дочитываемая частями
+};
+
+static struct vled_device_data *vled_devices;
+
+// Включается после выделения статистики всех светодиодов; пока выключен,
+// точки сбора статистики не стоят ничего, кроме пропущенного перехода
+static DEFINE_STATIC_KEY_FALSE(vled_stats_key);
+static struct dentry *vled_debugfs_root;
+
+// Шаги эффектов применяются под мьютексом устройства, поэтому таймер только
+// ставит работу в эту очередь с высоким приоритетом
+static struct workqueue_struct *vled_effect_wq;
+
+// Кадры сериализуются между собой; vled_frame_seq позволяет GET_FRAME
+// получить состояние панели без смешивания двух кадров. Внутри кадра берутся
+// мьютексы светодиодов, поэтому счетчик пишется raw_write_seqcount_*() без
+// запрета вытеснения, а читатель не ждет писателя, а берет vled_frame_lock.
+static DEFINE_MUTEX(vled_frame_lock);
+static seqcount_t vled_frame_seq = SEQCNT_ZERO(vled_frame_seq);
+
+// Старое журналирование команд в dmesg, только с параметром log_commands
+#define vled_log(fmt, ...)                                                  \
+    do {                                                                    \
+        if (unlikely(READ_ONCE(log_commands)))                              \
+            printk_ratelimited(KERN_INFO "Virtual LED: " fmt, ##__VA_ARGS__); \
+    } while (0)
+
+// Номер светодиода N в /dev/vledN
+static unsigned int vled_index(const struct vled_device_data *dev_data)
+{
+    return dev_data - vled_devices;
+}
+
+// Чтение и замена состояния одним словом (на 32-битных системах
+// согласованность по-прежнему обеспечивает seqcount)
+static union vled_packed vled_load(const struct vled_device_data *dev_data)
+{
+    union vled_packed s = { .word = READ_ONCE(dev_data->state.word) };
+    return s;
+}
+
+static void vled_store(struct vled_device_data *dev_data, union vled_packed s)
+{
+    WRITE_ONCE(dev_data->state.word, s.word);
+}
+
+static void vled_stat_inc(struct vled_device_data *dev_data, enum vled_stat stat)
+{
+    if (static_branch_unlikely(&vled_stats_key))
+        this_cpu_inc(dev_data->stats->counters[stat]);
+}
+
+// Отметка времени начала измеряемого участка, 0 без статистики
+static u64 vled_stat_clock(void)
+{
+    return static_branch_unlikely(&vled_stats_key) ? ktime_get_ns() : 0;
+}
+
+static void vled_stat_hist_add(struct vled_device_data *dev_data, enum vled_hist hist, u64 ns)
+{
+    unsigned int bucket = min_t(unsigned int, fls64(ns), VLED_HIST_BUCKETS - 1);
+    
+    this_cpu_inc(dev_data->stats->hist[hist][bucket]);
+}
+
+// Учет времени, прошедшего с vled_stat_clock()
+static void vled_stat_time(struct vled_device_data *dev_data, enum vled_hist hist, u64 start)
+{
+    if (static_branch_unlikely(&vled_stats_key))
+        vled_stat_hist_add(dev_data, hist, ktime_get_ns() - start);
+}
+
+// Добавление записи в журнал без блокировок: позиция резервируется
+// атомарным инкрементом, переполнение перезаписывает старые записи
+static void vled_event_record(struct vled_device_data *dev_data, u16 source,
+                              u16 field, u32 old_value, u32 new_value)
+{
+    unsigned long pos = atomic_long_fetch_inc(&dev_data->events_head);
+    struct vled_event_slot *slot = &dev_data->events[pos & (VLED_EVENTS_SIZE - 1)];
+    
+    WRITE_ONCE(slot->pos, 0);
+    smp_wmb();
+    slot->ev.timestamp_ns = ktime_get_ns();
+    slot->ev.seq = pos;
+    slot->ev.pid = task_tgid_vnr(current);
+    slot->ev.source = source;
+    slot->ev.field = field;
+    slot->ev.old_value = old_value;
+    slot->ev.new_value = new_value;
+    smp_store_release(&slot->pos, pos + 1);
+}
+
+// Запись для читателя опубликована (или уже перезаписана более новой)
+static bool vled_event_ready(struct vled_device_data *dev_data, struct vled_event_reader *reader)
+{
+    unsigned long pos = READ_ONCE(reader->pos);
+    struct vled_event_slot *slot = &dev_data->events[pos & (VLED_EVENTS_SIZE - 1)];
+    
+    if (atomic_long_read_acquire(&dev_data->events_head) == pos)
+        return false;
+    return (long)(smp_load_acquire(&slot->pos) - (pos + 1)) >= 0;
+}
+
+// Извлечение следующей записи читателя; -EAGAIN, если новых записей нет
+static int vled_event_fetch(struct vled_device_data *dev_data,
+                            struct vled_event_reader *reader, struct vled_event *ev)
+{
+    for (;;) {
+        unsigned long head = atomic_long_read_acquire(&dev_data->events_head);
+        unsigned long pos = reader->pos;
+        struct vled_event_slot *slot;
+        unsigned long seen;
+        
+        if (head == pos)
+            return -EAGAIN;
+        
+        // Читатель отстал больше чем на размер журнала
+        if (head - pos > VLED_EVENTS_SIZE) {
+            reader->lost += head - pos - VLED_EVENTS_SIZE;
+            reader->pos = pos = head - VLED_EVENTS_SIZE;
+        }
+        
+        slot = &dev_data->events[pos & (VLED_EVENTS_SIZE - 1)];
+        seen = smp_load_acquire(&slot->pos);
+        if ((long)(seen - (pos + 1)) < 0)
+            return -EAGAIN;     // Запись еще не опубликована
+        
+        if (seen == pos + 1) {
+            *ev = slot->ev;
+            smp_rmb();
+            if (READ_ONCE(slot->pos) == seen) {
+                reader->pos = pos + 1;
+                return 0;
+            }
+        }
+        
+        // Слот перезаписан писателем во время или до чтения
+        reader->lost++;
+        reader->pos = pos + 1;
+    }
+}
+
+// Публикация состояния в страницу mmap, вызывается под мьютексом
+static void vled_publish(struct vled_device_data *dev_data)
+{
+    struct vled_shared_page *page = dev_data->shared;
+    union vled_packed s = dev_data->state;
+    u32 seq = page->seq;
+    
+    WRITE_ONCE(page->seq, seq + 1);
+    smp_wmb();
+    WRITE_ONCE(page->led_state, s.led_state);
+    WRITE_ONCE(page->brightness, s.brightness);
+    WRITE_ONCE(page->color_index, s.color_index);
+    WRITE_ONCE(page->rgb, s.rgb);
+    vled_color_format(s, page->color);
+    smp_wmb();
+    WRITE_ONCE(page->seq, seq + 2);
+}
+
+// Захват мьютекса писателей с учетом ожидания в статистике
+static void vled_update_lock(struct vled_device_data *dev_data)
+{
+    if (!static_branch_unlikely(&vled_stats_key)) {
+        mutex_lock(&dev_data->lock);
+    } else if (mutex_trylock(&dev_data->lock)) {
+        vled_stat_hist_add(dev_data, VLED_HIST_LOCK_WAIT, 0);
+    } else {
+        u64 start = ktime_get_ns();
+        
+        mutex_lock(&dev_data->lock);
+        vled_stat_inc(dev_data, VLED_STAT_CONTENDED);
+        vled_stat_time(dev_data, VLED_HIST_LOCK_WAIT, start);
+    }
+}
+
+// Начало и конец изменения состояния: мьютекс сериализует писателей,
+// seqcount позволяет читателям обнаружить конкурентное изменение
+static void vled_update_begin(struct vled_device_data *dev_data)
+{
+    vled_update_lock(dev_data);
+    write_seqcount_begin(&dev_data->seq);
+}
+
+// Запись в журнал переходов для полей, значение которых действительно изменилось.
+// Предыдущее состояние берется из страницы mmap, она еще не обновлена.
+static void vled_record_changes(struct vled_device_data *dev_data, u32 changed, u16 source)
+{
+    struct vled_shared_page *page = dev_data->shared;
+    union vled_packed s = dev_data->state;
+    
+    if ((changed & VLED_SET_LED_STATE) && page->led_state != s.led_state)
+        vled_event_record(dev_data, source, VLED_SET_LED_STATE, page->led_state, s.led_state);
+    if ((changed & VLED_SET_BRIGHTNESS) && page->brightness != s.brightness)
+        vled_event_record(dev_data, source, VLED_SET_BRIGHTNESS, page->brightness, s.brightness);
+    if ((changed & VLED_SET_COLOR) && page->rgb != s.rgb)
+        vled_event_record(dev_data, source, VLED_SET_COLOR, page->rgb, s.rgb);
+}
+
+// Завершение изменения без уведомлений; source - источник для журнала (VLED_SRC_*)
+static void vled_update_commit(struct vled_device_data *dev_data, u32 changed, u16 source)
+{
+    vled_record_changes(dev_data, changed, source);
+    vled_publish(dev_data);
+    if (changed)
+        trace_vled_state_applied(vled_index(dev_data), source, changed, dev_data->state.led_state,
+                                 dev_data->state.brightness, dev_data->state.rgb);
+    write_seqcount_end(&dev_data->seq);
+    mutex_unlock(&dev_data->lock);
+}
+
+// Уведомление ожидающих poll()/read() и sysfs об измененных полях
+static void vled_notify(struct vled_device_data *dev_data, u32 changed)
+{
+    if (!changed)
+        return;
+    
+    wake_up_interruptible(&dev_data->wq);
+    // Атрибуты видны уже внутри device_create_with_groups(), до того как
+    // указатель на устройство сохранен в dev_data->dev
+    if (!READ_ONCE(dev_data->dev))
+        return;
+    sysfs_notify(&dev_data->dev->kobj, NULL, "state");
+    if (changed & VLED_SET_LED_STATE)
+        sysfs_notify(&dev_data->dev->kobj, NULL, "led_state");
+    if (changed & VLED_SET_BRIGHTNESS)
+        sysfs_notify(&dev_data->dev->kobj, NULL, "brightness");
+    if (changed & VLED_SET_COLOR) {
+        sysfs_notify(&dev_data->dev->kobj, NULL, "color");
+        sysfs_notify(&dev_data->dev->kobj, NULL, "rgb");
+    }
+}
+
+// changed - маска VLED_SET_* измененных полей для уведомления ожидающих,
+// source - источник изменения для журнала (VLED_SRC_*)
+static void vled_update_end(struct vled_device_data *dev_data, u32 changed, u16 source)
+{
+    vled_update_commit(dev_data, changed, source);
+    vled_notify(dev_data, changed);
+}
+
+// Согласованный снимок {state, brightness, color} без блокировки,
+// возвращает версию состояния. Состояние читается одним словом, seqcount
+// нужен только для того, чтобы версия соответствовала снимку.
+static unsigned int vled_snapshot_packed(struct vled_device_data *dev_data, union vled_packed *s)
+{
+    u64 start = vled_stat_clock();
+    unsigned int seq;
+    
+    do {
+        seq = read_seqcount_begin(&dev_data->seq);
+        *s = vled_load(dev_data);
+    } while (read_seqcount_retry(&dev_data->seq, seq));
+    
+    vled_stat_time(dev_data, VLED_HIST_SNAPSHOT, start);
+    return seq;
+}
+
+static unsigned int vled_snapshot(struct vled_device_data *dev_data, struct vled_state *st)
+{
+    union vled_packed s;
+    unsigned int seq = vled_snapshot_packed(dev_data, &s);
+    
+    vled_packed_to_state(s, st);
+    return seq;
+}
+
+// Применение проверенного (vled_state_validate) состояния одной записью
+// слова, вызывается между begin и end. Возвращает маску измененных полей.
+static u32 vled_state_apply(struct vled_device_data *dev_data, const struct vled_state *st)
+{
+    union vled_packed s = dev_data->state;
+    u32 changed = vled_packed_apply(&s, st);
+    
+    vled_store(dev_data, s);
+    return changed;
+}
+
+// Изменилось ли состояние с момента последнего чтения через эту сессию
+static bool vled_changed(struct vled_device_data *dev_data, struct vled_session *session)
+{
+    return (raw_read_seqcount(&dev_data->seq) & ~1U) != READ_ONCE(session->seen_seq);
+}
+
+// Движок эффектов. Значение эффекта - функция времени от effect_start,
+// поэтому задержки отдельных шагов не накапливаются.
+
+static int vled_effect_validate(struct vled_effect *eff)
+{
+    u32 i;
+    
+    if (eff->flags & ~(VLED_EFFECT_REPEAT | VLED_EFFECT_SMOOTH))
+        return -EINVAL;
+    if (eff->step_ms == 0)
+        eff->step_ms = VLED_EFFECT_DEFAULT_STEP_MS;
+    
+    switch (eff->type) {
+    case VLED_EFFECT_NONE:
+        return 0;
+    case VLED_EFFECT_BLINK:
+        return eff->blink.on_ms && eff->blink.off_ms ? 0 : -EINVAL;
+    case VLED_EFFECT_FADE:
+        return eff->fade.from <= 255 && eff->fade.to <= 255 &&
+               eff->fade.duration_ms ? 0 : -EINVAL;
+    case VLED_EFFECT_BREATHE:
+        return eff->breathe.min <= eff->breathe.max && eff->breathe.max <= 255 &&
+               eff->breathe.period_ms >= 2 ? 0 : -EINVAL;
+    case VLED_EFFECT_PATTERN:
+        if (eff->pattern.count == 0 || eff->pattern.count > VLED_EFFECT_MAX_KEYFRAMES)
+            return -EINVAL;
+        for (i = 0; i < eff->pattern.count; i++) {
+            const struct vled_keyframe *kf = &eff->pattern.keyframes[i];
+            if (kf->duration_ms == 0 || kf->led_state > 1 || kf->brightness > 255)
+                return -EINVAL;
+        }
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static u64 vled_mod_u64(u64 value, u64 divisor)
+{
+    u64 rem;
+    
+    div64_u64_rem(value, divisor, &rem);
+    return rem;
+}
+
+// Значение эффекта в момент t_ms от начала. Возвращает время следующего
+// шага от начала эффекта или -1, если эффект завершен.
+static s64 vled_effect_eval(const struct vled_effect *eff, u64 t_ms, struct vled_state *st)
+{
+    u64 pos, start = 0, next;
+    u32 i;
+    u64 x;
+    
+    st->mask = 0;
+    
+    switch (eff->type) {
+    case VLED_EFFECT_BLINK: {
+        u64 cycle = (u64)eff->blink.on_ms + eff->blink.off_ms;
+        pos = vled_mod_u64(t_ms, cycle);
+        st->mask = VLED_SET_LED_STATE;
+        st->led_state = pos < eff->blink.on_ms;
+        return t_ms - pos + (pos < eff->blink.on_ms ? eff->blink.on_ms : cycle);
+    }
+    case VLED_EFFECT_FADE: {
+        s32 delta = (s32)eff->fade.to - (s32)eff->fade.from;
+        st->mask = VLED_SET_BRIGHTNESS;
+        if (t_ms >= eff->fade.duration_ms) {
+            st->brightness = eff->fade.to;
+            return -1;
+        }
+        st->brightness = eff->fade.from + div_s64((s64)delta * t_ms, eff->fade.duration_ms);
+        return min_t(u64, t_ms + eff->step_ms, eff->fade.duration_ms);
+    }
+    case VLED_EFFECT_BREATHE: {
+        u32 period = eff->breathe.period_ms;
+        u32 half = period / 2;
+        pos = vled_mod_u64(t_ms, period);
+        // Треугольник 0..1024 с квадратичным сглаживанием
+        x = pos < half ? div_u64(pos * 1024, half) : div_u64((period - pos) * 1024, period - half);
+        x = x * x / 1024;
+        st->mask = VLED_SET_BRIGHTNESS;
+        st->brightness = eff->breathe.min + (u32)((eff->breathe.max - eff->breathe.min) * x / 1024);
+        return t_ms + eff->step_ms;
+    }
+    case VLED_EFFECT_PATTERN: {
+        const struct vled_keyframe *kf = eff->pattern.keyframes;
+        u32 count = eff->pattern.count;
+        u64 total = 0;
+        
+        for (i = 0; i < count; i++)
+            total += kf[i].duration_ms;
+        
+        st->mask = VLED_SET_LED_STATE | VLED_SET_BRIGHTNESS;
+        if (!(eff->flags & VLED_EFFECT_REPEAT) && t_ms >= total) {
+            st->led_state = kf[count - 1].led_state;
+            st->brightness = kf[count - 1].brightness;
+            return -1;
+        }
+        
+        pos = vled_mod_u64(t_ms, total);
+        for (i = 0; i < count - 1 && pos >= start + kf[i].duration_ms; i++)
+            start += kf[i].duration_ms;
+        
+        st->led_state = kf[i].led_state;
+        st->brightness = kf[i].brightness;
+        next = t_ms - pos + start + kf[i].duration_ms;
+        
+        if ((eff->flags & VLED_EFFECT_SMOOTH) &&
+            (i + 1 < count || (eff->flags & VLED_EFFECT_REPEAT))) {
+            const struct vled_keyframe *to = &kf[(i + 1) % count];
+            s32 delta = (s32)to->brightness - (s32)kf[i].brightness;
+            st->brightness = kf[i].brightness +
+                             div_s64((s64)delta * (pos - start), kf[i].duration_ms);
+            next = min_t(u64, next, t_ms + eff->step_ms);
+        }
+        return next;
+    }
+    default:
+        return -1;
+    }
+}
+
+static enum hrtimer_restart vled_effect_timer_fn(struct hrtimer *timer)
+{
+    struct vled_device_data *dev_data = container_of(timer, struct vled_device_data, effect_timer);
+    
+    queue_work(vled_effect_wq, &dev_data->effect_work);
+    return HRTIMER_NORESTART;
+}
+
+static void vled_effect_work_fn(struct work_struct *work)
+{
+    struct vled_device_data *dev_data = container_of(work, struct vled_device_data, effect_work);
+    union vled_packed s;
+    struct vled_state st;
+    s64 next;
+    u64 t_ms;
+    
+    mutex_lock(&dev_data->lock);
+    if (dev_data->effect.type == VLED_EFFECT_NONE) {
+        mutex_unlock(&dev_data->lock);
+        return;
+    }
+    write_seqcount_begin(&dev_data->seq);
+    
+    t_ms = ktime_ms_delta(ktime_get(), dev_data->effect_start);
+    next = vled_effect_eval(&dev_data->effect, t_ms, &st);
+    s = dev_data->state;
+    if (st.mask & VLED_SET_LED_STATE)
+        s.led_state = st.led_state;
+    if (st.mask & VLED_SET_BRIGHTNESS)
+        s.brightness = st.brightness;
+    vled_store(dev_data, s);
+    
+    // Таймер взводится под мьютексом, чтобы остановка не пропустила его
+    if (next < 0)
+        dev_data->effect.type = VLED_EFFECT_NONE;
+    else
+        hrtimer_start(&dev_data->effect_timer,
+                      ktime_add_ms(dev_data->effect_start, next), HRTIMER_MODE_ABS);
+    vled_update_commit(dev_data, st.mask, VLED_SRC_EFFECT);
+    vled_notify(dev_data, st.mask);
+}
+
+// Остановка текущего эффекта, вызывается под effect_lock
+static void vled_effect_stop(struct vled_device_data *dev_data)
+{
+    mutex_lock(&dev_data->lock);
+    dev_data->effect.type = VLED_EFFECT_NONE;
+    mutex_unlock(&dev_data->lock);
+    
+    hrtimer_cancel(&dev_data->effect_timer);
+    cancel_work_sync(&dev_data->effect_work);
+    hrtimer_cancel(&dev_data->effect_timer);
+}
+
+// Запуск проверенного эффекта, вызывается под effect_lock
+static void vled_effect_start_locked(struct vled_device_data *dev_data,
+                                     const struct vled_effect *eff)
+{
+    vled_effect_stop(dev_data);
+    if (eff->type != VLED_EFFECT_NONE) {
+        mutex_lock(&dev_data->lock);
+        dev_data->effect = *eff;
+        dev_data->effect_start = ktime_get();
+        mutex_unlock(&dev_data->lock);
+        queue_work(vled_effect_wq, &dev_data->effect_work);
+    }
+}
+
+// Запуск эффекта (VLED_EFFECT_NONE только останавливает текущий)
+static int vled_effect_start(struct vled_device_data *dev_data, struct vled_effect *eff)
+{
+    int retval = vled_effect_validate(eff);
+    if (retval)
+        return retval;
+    
+    mutex_lock(&dev_data->effect_lock);
+    vled_effect_start_locked(dev_data, eff);
+    mutex_unlock(&dev_data->effect_lock);
+    return 0;
+}
+
+// Текстовая форма эффекта, общая для команды EFFECT и атрибута sysfs:
+//   none | blink ON_MS OFF_MS | fade FROM TO MS | breathe MIN MAX PERIOD_MS |
+//   pattern [repeat] [smooth] MS:STATE:BRIGHTNESS ...
+static int vled_effect_parse(char *buf, struct vled_effect *eff)
+{
+    char *p = strim(buf);
+    char *tok = strsep(&p, " ");
+    
+    memset(eff, 0, sizeof(*eff));
+    if (!p)
+        p = "";
+    
+    if (strcmp(tok, "none") == 0) {
+        eff->type = VLED_EFFECT_NONE;
+    } else if (strcmp(tok, "blink") == 0) {
+        eff->type = VLED_EFFECT_BLINK;
+        if (sscanf(p, "%u %u", &eff->blink.on_ms, &eff->blink.off_ms) != 2)
+            return -EINVAL;
+    } else if (strcmp(tok, "fade") == 0) {
+        eff->type = VLED_EFFECT_FADE;
+        if (sscanf(p, "%u %u %u", &eff->fade.from, &eff->fade.to, &eff->fade.duration_ms) != 3)
+            return -EINVAL;
+    } else if (strcmp(tok, "breathe") == 0) {
+        eff->type = VLED_EFFECT_BREATHE;
+        if (sscanf(p, "%u %u %u", &eff->breathe.min, &eff->breathe.max, &eff->breathe.period_ms) != 3)
+            return -EINVAL;
+    } else if (strcmp(tok, "pattern") == 0) {
+        eff->type = VLED_EFFECT_PATTERN;
+        while ((tok = strsep(&p, " ")) != NULL) {
+            struct vled_keyframe *kf;
+            
+            if (*tok == '\0')
+                continue;
+            if (strcmp(tok, "repeat") == 0) {
+                eff->flags |= VLED_EFFECT_REPEAT;
+                continue;
+            }
+            if (strcmp(tok, "smooth") == 0) {
+                eff->flags |= VLED_EFFECT_SMOOTH;
+                continue;
+            }
+            if (eff->pattern.count == VLED_EFFECT_MAX_KEYFRAMES)
+                return -EINVAL;
+            kf = &eff->pattern.keyframes[eff->pattern.count++];
+            if (sscanf(tok, "%u:%u:%u", &kf->duration_ms, &kf->led_state, &kf->brightness) != 3)
+                return -EINVAL;
+        }
+    } else {
+        return -EINVAL;
+    }
+    
+    return vled_effect_validate(eff);
+}
+
+static ssize_t vled_effect_format(const struct vled_effect *eff, char *buf)
+{
+    ssize_t len;
+    u32 i;
+    
+    switch (eff->type) {
+    case VLED_EFFECT_BLINK:
+        return sprintf(buf, "blink %u %u\n", eff->blink.on_ms, eff->blink.off_ms);
+    case VLED_EFFECT_FADE:
+        return sprintf(buf, "fade %u %u %u\n", eff->fade.from, eff->fade.to, eff->fade.duration_ms);
+    case VLED_EFFECT_BREATHE:
+        return sprintf(buf, "breathe %u %u %u\n",
+                       eff->breathe.min, eff->breathe.max, eff->breathe.period_ms);
+    case VLED_EFFECT_PATTERN:
+        len = sprintf(buf, "pattern%s%s",
+                      eff->flags & VLED_EFFECT_REPEAT ? " repeat" : "",
+                      eff->flags & VLED_EFFECT_SMOOTH ? " smooth" : "");
+        for (i = 0; i < eff->pattern.count; i++)
+            len += sprintf(buf + len, " %u:%u:%u",
+                           eff->pattern.keyframes[i].duration_ms,
+                           eff->pattern.keyframes[i].led_state,
+                           eff->pattern.keyframes[i].brightness);
+        return len + sprintf(buf + len, "\n");
+    default:
+        return sprintf(buf, "none\n");
+    }
+}
+
+static void vled_effect_get(struct vled_device_data *dev_data, struct vled_effect *eff)
+{
+    mutex_lock(&dev_data->lock);
+    *eff = dev_data->effect;
+    mutex_unlock(&dev_data->lock);
+}
+
+// Функции для работы с файловой системой
+static struct vled_device_data *vled_file_dev(struct file *filep)
+{
+    return &vled_devices[iminor(file_inode(filep))];
+}
+
+// Сессия дескриптора создается при первом запросе; до этого open, read и
+// write целых команд не выделяют память
+static struct vled_session *vled_file_session(struct file *filep)
+{
+    struct vled_session *session = READ_ONCE(filep->private_data);
+    struct vled_session *old;
+    
+    if (session)
+        return session;
+    
+    session = kzalloc(sizeof(*session), GFP_KERNEL);
+    if (!session)
+        return NULL;
+    session->seen_seq = raw_read_seqcount(&vled_file_dev(filep)->seq) & ~1U;
+    session->read_mode = VLED_READ_SNAPSHOT;
+    mutex_init(&session->write_lock);
+    mutex_init(&session->read_lock);
+    
+    old = cmpxchg(&filep->private_data, NULL, session);
+    if (old) {
+        mutex_destroy(&session->read_lock);
+        mutex_destroy(&session->write_lock);
+        kfree(session);
+        return old;
+    }
+    return session;
+}
+
+static int vled_open(struct inode *inodep, struct file *filep)
+{
+    // Все дескрипторы работают с одним состоянием устройства, без выделения памяти
+    filep->private_data = NULL;
+    vled_stat_inc(vled_file_dev(filep), VLED_STAT_OPENS);
+    return 0;
+}
+
+
+// Новая запись для read() в буфер сессии, вызывается под read_lock
+static void vled_read_fill(struct vled_device_data *dev_data, struct vled_session *session)
+{
+    union vled_packed s;
+    unsigned int seq = vled_snapshot_packed(dev_data, &s);
+    int n = vled_state_render(s, seq, READ_ONCE(session->read_format),
+                              session->read_buf, sizeof(session->read_buf));
+    
+    session->read_len = clamp(n, 0, (int)sizeof(session->read_buf) - 1);
+    session->read_pos = 0;
+    WRITE_ONCE(session->seen_seq, seq);
+}
+
+// Часть записи с позиции pos, вызывается под read_lock
+static ssize_t vled_read_copy(struct vled_session *session, char *buffer, size_t len, loff_t pos)
+{
+    if (pos >= session->read_len)
+        return 0;
+    len = min_t(size_t, len, session->read_len - pos);
+    if (copy_to_user(buffer, session->read_buf + pos, len))
+        return -EFAULT;
+    return len;
+}
+
+// Снимок читается с позиции 0 и дочитывается из того же снимка, поэтому
+// маленький буфер не получает смесь двух состояний. В режиме ожидания
+// позиция ведется в сессии: остаток записи отдается без ожидания.
+static ssize_t vled_read(struct file *filep, char *buffer, size_t len, loff_t *offset)
+{
+    struct vled_device_data *dev_data = vled_file_dev(filep);
+    struct vled_session *session = READ_ONCE(filep->private_data);
+    ssize_t retval;
+    
+    vled_stat_inc(dev_data, VLED_STAT_READS);
+    
+    // Без сессии - текстовый снимок целиком, без выделения памяти
+    if (!session) {
+        union vled_packed s;
+        char state_info[VLED_READ_MAX];
+        int bytes_to_copy;
+        
+        if (*offset > 0)
+            return 0;
+        vled_snapshot_packed(dev_data, &s);
+        bytes_to_copy = vled_state_format(s, state_info, sizeof(state_info));
+        if (len >= bytes_to_copy) {
+            if (copy_to_user(buffer, state_info, bytes_to_copy))
+                return -EFAULT;
+            *offset = bytes_to_copy;
+            return bytes_to_copy;
+        }
+        
+        // Чтение частями: остаток снимка хранится в сессии
+        session = vled_file_session(filep);
+        if (!session)
+            return -ENOMEM;
+    }
+    
+    if (READ_ONCE(session->read_mode) == VLED_READ_WAIT) {
+        mutex_lock(&session->read_lock);
+        if (session->read_pos >= session->read_len) {
+            mutex_unlock(&session->read_lock);
+            
+            // Блокирующий режим: каждая запись соответствует следующему изменению
+            if (!vled_changed(dev_data, session)) {
+                if (filep->f_flags & O_NONBLOCK)
+                    return -EAGAIN;
+                if (wait_event_interruptible(dev_data->wq, vled_changed(dev_data, session)))
+                    return -ERESTARTSYS;
+            }
+            mutex_lock(&session->read_lock);
+            vled_read_fill(dev_data, session);
+        }
+        retval = vled_read_copy(session, buffer, len, session->read_pos);
+        if (retval > 0)
+            session->read_pos += retval;
+        mutex_unlock(&session->read_lock);
+        return retval;
+    }
+    
+    mutex_lock(&session->read_lock);
+    if (*offset == 0)
+        vled_read_fill(dev_data, session);
+    retval = vled_read_copy(session, buffer, len, *offset);
+    if (retval > 0)
+        *offset += retval;
+    mutex_unlock(&session->read_lock);
+    return retval;
+}
+
+// Команды одной записи: ON/OFF/BRIGHTNESS/COLOR объединяются в batch и
+// применяются одной критической секцией; EFFECT сначала применяет
+// накопленное, чтобы сохранить порядок команд
+struct vled_write_batch {
+    struct vled_state st;
+    struct vled_write_status status;
+};
+
+static void vled_write_reject(struct vled_device_data *dev_data, struct vled_write_batch *batch,
+                              const char *cmd, int error)
+{
+    batch->status.rejected++;
+    if (!batch->status.first_error) {
+        batch->status.first_error = batch->status.commands;
+        batch->status.error = error;
+    }
+    vled_stat_inc(dev_data, VLED_STAT_REJECTED);
+    trace_vled_command_rejected(vled_index(dev_data), VLED_SRC_CHARDEV, cmd, error);
+}
+
+static void vled_write_apply(struct vled_device_data *dev_data, struct vled_write_batch *batch)
+{
+    if (!batch->st.mask)
+        return;
+    vled_update_begin(dev_data);
+    vled_update_end(dev_data, vled_state_apply(dev_data, &batch->st), VLED_SRC_CHARDEV);
+    batch->st.mask = 0;
+}
+
+// Одна завершенная команда; result - результат vled_cmd_stream_next()
+static void vled_write_command(struct vled_device_data *dev_data, struct vled_write_batch *batch,
+                               char *cmd, int result)
+{
+    struct vled_state st;
+    
+    if (result > 0 && cmd[0] == '\0')
+        return;
+    batch->status.commands++;
+    if (result < 0) {
+        vled_write_reject(dev_data, batch, "", result);
+        return;
+    }
+    trace_vled_command(vled_index(dev_data), VLED_SRC_CHARDEV, cmd);
+    
+    // Эффект запускается вне критической секции: остановка старого
+    // эффекта ждет завершения его шага, который берет мьютекс устройства
+    if (strncmp(cmd, "EFFECT ", 7) == 0) {
+        struct vled_effect eff;
+        int retval;
+        
+        vled_write_apply(dev_data, batch);
+        retval = vled_effect_parse(cmd + 7, &eff);
+        if (retval == 0)
+            retval = vled_effect_start(dev_data, &eff);
+        if (retval == 0)
+            batch->status.applied++;
+        else
+            vled_write_reject(dev_data, batch, "EFFECT", retval);
+        return;
+    }
+    
+    // Разбор команды - общее ядро (vled_core.h)
+    if (vled_command_parse(cmd, &st)) {
+        vled_write_reject(dev_data, batch, cmd, -EINVAL);
+        return;
+    }
+    vled_state_merge(&batch->st, &st);
+    batch->status.applied++;
+    vled_log("Command: %s\n", cmd);
+}
+
+// Запись может содержать любое число команд, разделенных '\n'. Хвост без
+// '\n' всегда сохраняется в сессии дескриптора и продолжается следующей
+// записью; выполняется он по fsync() или при закрытии. Сессия создается,
+// только если нужно сохранить хвост или итог записи с ошибками; итог
+// возвращает VLED_IOC_GET_WRITE_STATUS.
+static ssize_t vled_write(struct file *filep, const char *buffer, size_t len, loff_t *offset)
+{
+    struct vled_device_data *dev_data = vled_file_dev(filep);
+    struct vled_session *session = READ_ONCE(filep->private_data);
+    struct vled_write_batch batch = {};
+    struct vled_cmd_stream local;
+    struct vled_cmd_stream *stream;
+    bool fault = false;
+    char chunk[256];
+    size_t done = 0;
+    u64 start;
+    
+    vled_stat_inc(dev_data, VLED_STAT_WRITES);
+    if (!len)
+        return 0;
+    
+    start = vled_stat_clock();
+    if (session) {
+        mutex_lock(&session->write_lock);
+        stream = &session->stream;
+    } else {
+        local.len = 0;
+        local.overflow = 0;
+        stream = &local;
+    }
+    
+    while (done < len) {
+        size_t n = min(len - done, sizeof(chunk));
+        const char *p = chunk;
+        int result;
+        
+        if (copy_from_user(chunk, buffer + done, n)) {
+            fault = true;
+            break;
+        }
+        done += n;
+        while ((result = vled_cmd_stream_next(stream, &p, &n)) != 0)
+            vled_write_command(dev_data, &batch, stream->line, result);
+    }
+    vled_write_apply(dev_data, &batch);
+    
+    // Хвост без '\n' или ошибки требуют сессии. Если памяти нет, хвост
+    // не считается записанным: write() вернет меньше len.
+    if (!session && (vled_cmd_stream_pending(stream) || batch.status.rejected)) {
+        session = vled_file_session(filep);
+        if (session) {
+            mutex_lock(&session->write_lock);
+            session->stream = local;
+        } else if (vled_cmd_stream_pending(stream)) {
+            done -= min_t(size_t, done, local.len);
+        }
+    }
+    if (session) {
+        batch.status.pending = session->stream.len;
+        session->write_status = batch.status;
+        mutex_unlock(&session->write_lock);
+    }
+    
+    if (batch.status.applied)
+        vled_stat_time(dev_data, VLED_HIST_WRITE, start);
+    // Ошибку отдаем, только если не записано ни байта
+    if (!done)
+        return fault ? -EFAULT : -ENOMEM;
+    return done;
+}
+
+// Выполнение сохраненного хвоста без '\n', вызывается под write_lock.
+// Возвращает ошибку этой команды или 0.
+static int vled_write_flush(struct vled_device_data *dev_data, struct vled_session *session)
+{
+    struct vled_write_batch batch = {};
+    
+    if (!vled_cmd_stream_pending(&session->stream))
+        return 0;
+    vled_write_command(dev_data, &batch, session->stream.line,
+                       vled_cmd_stream_finish(&session->stream));
+    vled_write_apply(dev_data, &batch);
+    session->write_status = batch.status;
+    return batch.status.error;
+}
+
+static int vled_fsync(struct file *filep, loff_t start, loff_t end, int datasync)
+{
+    struct vled_session *session = READ_ONCE(filep->private_data);
+    int retval;
+    
+    if (!session)
+        return 0;
+    mutex_lock(&session->write_lock);
+    retval = vled_write_flush(vled_file_dev(filep), session);
+    mutex_unlock(&session->write_lock);
+    return retval;
+}
+
+static int vled_release(struct inode *inodep, struct file *filep)
+{
+    struct vled_session *session = filep->private_data;
+    
+    if (!session)
+        return 0;
+    
+    // Хвост без завершающего '\n' выполняется при закрытии
+    vled_write_flush(vled_file_dev(filep), session);
+    mutex_destroy(&session->read_lock);
+    mutex_destroy(&session->write_lock);
+    kfree(session);
+    return 0;
+}
+
+// Копирование массива обновлений кадра из пространства пользователя
+static struct vled_led_update *vled_frame_copy(void __user *argp, struct vled_frame *frame)
+{
+    if (copy_from_user(frame, argp, sizeof(*frame)))
+        return ERR_PTR(-EFAULT);
+    if (frame->reserved || frame->count == 0 || frame->count > VLED_FRAME_MAX)
+        return ERR_PTR(-EINVAL);
+    
+    return vmemdup_user(u64_to_user_ptr(frame->updates),
+                        array_size(frame->count, sizeof(struct vled_led_update)));
+}
+
+// Пакетное обновление: проверка всего кадра, применение одной публикацией
+// vled_frame_seq и одно уведомление на каждый затронутый светодиод
+static long vled_ioctl_set_frame(void __user *argp)
+{
+    struct vled_led_update *updates;
+    struct vled_frame frame;
+    u32 i;
+    long retval = 0;
+    
+    updates = vled_frame_copy(argp, &frame);
+    if (IS_ERR(updates))
+        return PTR_ERR(updates);
+    
+    for (i = 0; i < frame.count; i++) {
+        if (updates[i].index >= num_devices || vled_state_validate(&updates[i].state)) {
+            retval = -EINVAL;
+            goto out;
+        }
+    }
+    
+    mutex_lock(&vled_frame_lock);
+    raw_write_seqcount_begin(&vled_frame_seq);
+    for (i = 0; i < frame.count; i++) {
+        struct vled_device_data *dev_data = &vled_devices[updates[i].index];
+        u32 changed;
+        
+        vled_update_begin(dev_data);
+        changed = vled_state_apply(dev_data, &updates[i].state);
+        vled_update_commit(dev_data, changed, VLED_SRC_IOCTL);
+        dev_data->frame_changed |= changed;
+    }
+    raw_write_seqcount_end(&vled_frame_seq);
+    
+    // Уведомления после публикации всего кадра, по одному на светодиод
+    for (i = 0; i < frame.count; i++) {
+        struct vled_device_data *dev_data = &vled_devices[updates[i].index];
+        
+        if (dev_data->frame_changed) {
+            vled_notify(dev_data, dev_data->frame_changed);
+            dev_data->frame_changed = 0;
+        }
+    }
+    mutex_unlock(&vled_frame_lock);
+    
+out:
+    kvfree(updates);
+    return retval;
+}
+
+// Чтение состояния набора светодиодов, не разрывающее ни один кадр
+static long vled_ioctl_get_frame(void __user *argp)
+{
+    struct vled_led_update *updates;
+    struct vled_frame frame;
+    unsigned int seq;
+    u32 i;
+    long retval = 0;
+    
+    updates = vled_frame_copy(argp, &frame);
+    if (IS_ERR(updates))
+        return PTR_ERR(updates);
+    
+    for (i = 0; i < frame.count; i++) {
+        if (updates[i].index >= num_devices) {
+            retval = -EINVAL;
+            goto out;
+        }
+    }
+    
+    // Без блокировки, если кадр сейчас не пишется; иначе писатель может спать
+    // на мьютексе светодиода, и кадр дочитывается под vled_frame_lock
+    seq = raw_read_seqcount(&vled_frame_seq);
+    if (!(seq & 1)) {
+        for (i = 0; i < frame.count; i++)
+            vled_snapshot(&vled_devices[updates[i].index], &updates[i].state);
+    }
+    if ((seq & 1) || read_seqcount_retry(&vled_frame_seq, seq)) {
+        mutex_lock(&vled_frame_lock);
+        for (i = 0; i < frame.count; i++)
+            vled_snapshot(&vled_devices[updates[i].index], &updates[i].state);
+        mutex_unlock(&vled_frame_lock);
+    }
+    
+    if (copy_to_user(u64_to_user_ptr(frame.updates), updates,
+                     array_size(frame.count, sizeof(*updates))))
+        retval = -EFAULT;
+    
+out:
+    kvfree(updates);
+    return retval;
+}
+
+// Транзакционное изменение: условие по версии проверяется под мьютексом
+// писателей, поэтому между проверкой и применением никто не вмешается.
+// При несовпадении версии состояние не меняется и версия не растет.
+static long vled_ioctl_update_state(struct vled_device_data *dev_data, void __user *argp)
+{
+    struct vled_state_update upd;
+    union vled_packed s;
+    u32 changed;
+    u64 start;
+    long retval = 0;
+    
+    if (copy_from_user(&upd, argp, sizeof(upd)))
+        return -EFAULT;
+    if ((upd.flags & ~VLED_UPDATE_IF_SEQ) || upd.reserved || vled_state_validate(&upd.state)) {
+        vled_stat_inc(dev_data, VLED_STAT_REJECTED);
+        trace_vled_command_rejected(vled_index(dev_data), VLED_SRC_IOCTL, "UPDATE_STATE", -EINVAL);
+        return -EINVAL;
+    }
+    
+    start = vled_stat_clock();
+    vled_update_lock(dev_data);
+    upd.seq = raw_read_seqcount(&dev_data->seq);
+    if ((upd.flags & VLED_UPDATE_IF_SEQ) && upd.seq != upd.expected_seq)
+        retval = -EAGAIN;
+    
+    if (retval == 0 && upd.state.mask) {
+        write_seqcount_begin(&dev_data->seq);
+        changed = vled_state_apply(dev_data, &upd.state);
+        s = dev_data->state;
+        vled_update_end(dev_data, changed, VLED_SRC_IOCTL);
+        vled_stat_time(dev_data, VLED_HIST_WRITE, start);
+        upd.seq += 2;
+    } else {
+        s = dev_data->state;
+        mutex_unlock(&dev_data->lock);
+    }
+    vled_packed_to_state(s, &upd.state);
+    
+    if (copy_to_user(argp, &upd, sizeof(upd)))
+        return -EFAULT;
+    return retval;
+}
+
+// Бинарный интерфейс управления без разбора текста
+static long vled_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    struct vled_device_data *dev_data = vled_file_dev(filep);
+    void __user *argp = (void __user *)arg;
+    struct vled_session *session;
+    struct vled_effect eff;
+    struct vled_state st;
+    __u32 mode;
+    u64 start;
+    
+    vled_stat_inc(dev_data, VLED_STAT_IOCTLS);
+    
+    switch (cmd) {
+    case VLED_IOC_GET_VERSION: {
+        __u32 version = VLED_ABI_VERSION;
+        if (copy_to_user(argp, &version, sizeof(version)))
+            return -EFAULT;
+        return 0;
+    }
+    case VLED_IOC_GET_STATE:
+        vled_snapshot(dev_data, &st);
+        if (copy_to_user(argp, &st, sizeof(st)))
+            return -EFAULT;
+        return 0;
+    case VLED_IOC_SET_STATE:
+        if (copy_from_user(&st, argp, sizeof(st)))
+            return -EFAULT;
+        start = vled_stat_clock();
+        if (vled_state_validate(&st)) {
+            vled_stat_inc(dev_data, VLED_STAT_REJECTED);
+            trace_vled_command_rejected(vled_index(dev_data), VLED_SRC_IOCTL, "SET_STATE", -EINVAL);
+            return -EINVAL;
+        }
+        
+        vled_update_begin(dev_data);
+        vled_update_end(dev_data, vled_state_apply(dev_data, &st), VLED_SRC_IOCTL);
+        vled_stat_time(dev_data, VLED_HIST_WRITE, start);
+        return 0;
+    case VLED_IOC_UPDATE_STATE:
+        return vled_ioctl_update_state(dev_data, argp);
+    case VLED_IOC_SET_FRAME:
+        return vled_ioctl_set_frame(argp);
+    case VLED_IOC_GET_FRAME:
+        return vled_ioctl_get_frame(argp);
+    case VLED_IOC_SET_EFFECT:
+        if (copy_from_user(&eff, argp, sizeof(eff)))
+            return -EFAULT;
+        return vled_effect_start(dev_data, &eff);
+    case VLED_IOC_GET_EFFECT:
+        vled_effect_get(dev_data, &eff);
+        if (copy_to_user(argp, &eff, sizeof(eff)))
+            return -EFAULT;
+        return 0;
+    case VLED_IOC_GET_WRITE_STATUS: {
+        struct vled_write_status status;
+        
+        // Сессия создается здесь, чтобы следующие записи сохраняли итог
+        // и без ошибок
+        session = vled_file_session(filep);
+        if (!session)
+            return -ENOMEM;
+        mutex_lock(&session->write_lock);
+        status = session->write_status;
+        mutex_unlock(&session->write_lock);
+        if (copy_to_user(argp, &status, sizeof(status)))
+            return -EFAULT;
+        return 0;
+    }
+    case VLED_IOC_SET_READ_MODE:
+        if (get_user(mode, (__u32 __user *)argp))
+            return -EFAULT;
+        if (mode != VLED_READ_SNAPSHOT && mode != VLED_READ_WAIT)
+            return -EINVAL;
+        session = vled_file_session(filep);
+        if (!session)
+            return -ENOMEM;
+        WRITE_ONCE(session->read_mode, mode);
+        return 0;
+    case VLED_IOC_SET_READ_FORMAT:
+        if (get_user(mode, (__u32 __user *)argp))
+            return -EFAULT;
+        if (mode > VLED_FORMAT_BINARY)
+            return -EINVAL;
+        session = vled_file_session(filep);
+        if (!session)
+            return -ENOMEM;
+        // Недочитанная запись в старом формате отбрасывается
+        mutex_lock(&session->read_lock);
+        WRITE_ONCE(session->read_format, mode);
+        session->read_len = 0;
+        session->read_pos = 0;
+        mutex_unlock(&session->read_lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+// Отображение страницы состояния в память процесса (только чтение)
+static int vled_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+    struct vled_device_data *dev_data = vled_file_dev(filep);
+    unsigned long size = vma->vm_end - vma->vm_start;
+    
+    if (vma->vm_pgoff != 0 || size > PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return remap_pfn_range(vma, vma->vm_start,
+                           virt_to_phys(dev_data->shared) >> PAGE_SHIFT,
+                           size, vma->vm_page_prot);
+}
+
+// Готовность к чтению означает, что состояние изменилось с последнего read().
+// write() никогда не блокируется, поэтому запись готова всегда.
+static __poll_t vled_poll(struct file *filep, poll_table *wait)
+{
+    struct vled_device_data *dev_data = vled_file_dev(filep);
+    struct vled_session *session = vled_file_session(filep);
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+    
+    if (!session)
+        return mask | EPOLLERR;
+    
+    poll_wait(filep, &dev_data->wq, wait);
+    
+    if (vled_changed(dev_data, session))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    return mask;
+}
+
+// Операции файловых операций
+static struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .open = vled_open,
+    .read = vled_read,
+    .write = vled_write,
+    .unlocked_ioctl = vled_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = vled_mmap,
+    .poll = vled_poll,
+    .fsync = vled_fsync,
+    .release = vled_release,
 };
 
-static struct vled_device_data device_data;
-
-// Функции для работы с файловой системой
-static int vled_open(struct inode *inodep, struct file *filep)
+// Функции узла журнала событий /dev/vled_events
+static int vled_events_open(struct inode *inodep, struct file *filep)
 {
-    struct vled_device_data *dev_data;
-    dev_data = kmalloc(sizeof(struct vled_device_data), GFP_KERNEL);
-    if (!dev_data)
+    struct vled_device_data *dev_data = &vled_devices[iminor(inodep) - num_devices];
+    struct vled_event_reader *reader;
+    unsigned long head;
+    
+    reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    if (!reader)
         return -ENOMEM;
     
-    mutex_init(&dev_data->lock);
-    dev_data->led_state = 0;
-    dev_data->brightness = 128;
-    strcpy(dev_data->color, "green");
+    // Новый читатель получает всю сохранившуюся историю
+    head = atomic_long_read(&dev_data->events_head);
+    reader->dev = dev_data;
+    reader->pos = head > VLED_EVENTS_SIZE ? head - VLED_EVENTS_SIZE : 0;
+    mutex_init(&reader->lock);
     
-    filep->private_data = dev_data;
+    filep->private_data = reader;
+    return stream_open(inodep, filep);
+}
+
+static int vled_events_release(struct inode *inodep, struct file *filep)
+{
+    struct vled_event_reader *reader = filep->private_data;
+    mutex_destroy(&reader->lock);
+    kfree(reader);
     return 0;
 }
 
-static int vled_release(struct inode *inodep, struct file *filep)
+// Чтение целых записей struct vled_event; блокируется, пока журнал пуст
+static ssize_t vled_events_read(struct file *filep, char __user *buffer, size_t len, loff_t *offset)
 {
-    struct vled_device_data *dev_data = filep->private_data;
-    mutex_destroy(&dev_data->lock);
-    kfree(dev_data);
+    struct vled_event_reader *reader = filep->private_data;
+    struct vled_device_data *dev_data = reader->dev;
+    struct vled_event ev;
+    ssize_t copied = 0;
+    
+    if (len < sizeof(ev))
+        return -EINVAL;
+    
+    if (mutex_lock_interruptible(&reader->lock))
+        return -ERESTARTSYS;
+    
+    for (;;) {
+        while (copied + sizeof(ev) <= len && vled_event_fetch(dev_data, reader, &ev) == 0) {
+            if (copy_to_user(buffer + copied, &ev, sizeof(ev))) {
+                if (!copied)
+                    copied = -EFAULT;
+                goto out;
+            }
+            copied += sizeof(ev);
+        }
+        
+        if (copied)
+            break;
+        if (filep->f_flags & O_NONBLOCK) {
+            copied = -EAGAIN;
+            break;
+        }
+        
+        mutex_unlock(&reader->lock);
+        if (wait_event_interruptible(dev_data->wq, vled_event_ready(dev_data, reader)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&reader->lock))
+            return -ERESTARTSYS;
+    }
+    
+out:
+    mutex_unlock(&reader->lock);
+    return copied;
+}
+
+static __poll_t vled_events_poll(struct file *filep, poll_table *wait)
+{
+    struct vled_event_reader *reader = filep->private_data;
+    
+    poll_wait(filep, &reader->dev->wq, wait);
+    
+    if (vled_event_ready(reader->dev, reader))
+        return EPOLLIN | EPOLLRDNORM;
     return 0;
 }
 
-static ssize_t vled_read(struct file *filep, char *buffer, size_t len, loff_t *offset)
+static long vled_events_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 {
-    struct vled_device_data *dev_data = filep->private_data;
-    char state_info[256];
-    int bytes_to_copy;
+    struct vled_event_reader *reader = filep->private_data;
     
-    if (*offset > 0)
+    switch (cmd) {
+    case VLED_IOC_EVENTS_LOST:
+        if (put_user(READ_ONCE(reader->lost), (__u64 __user *)arg))
+            return -EFAULT;
         return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static struct file_operations events_fops = {
+    .owner = THIS_MODULE,
+    .open = vled_events_open,
+    .read = vled_events_read,
+    .poll = vled_events_poll,
+    .unlocked_ioctl = vled_events_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .release = vled_events_release,
+};
+
+#if IS_ENABLED(CONFIG_LEDS_CLASS)
+// Интеграция с подсистемой LED: триггеры ядра (timer, heartbeat, disk-activity,
+// netdev) управляют светодиодом без участия пространства пользователя.
+// Используется brightness_set_blocking, так как состояние защищено мьютексом;
+// вызовы из атомарного контекста ядро само переносит в рабочую очередь.
+
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+static struct led_classdev *vled_led_cdev(struct vled_device_data *dev_data)
+{
+    return &dev_data->led_mc.led_cdev;
+}
+
+static struct vled_device_data *vled_led_dev(struct led_classdev *cdev)
+{
+    return container_of(lcdev_to_mccdev(cdev), struct vled_device_data, led_mc);
+}
+
+// Цвет из каналов R, G, B. Яркость каналов считает ядро
+// (led_mc_calc_color_components) для полной яркости: яркость светодиода
+// хранится отдельно, и их произведение дает каналы для текущей яркости.
+static u32 vled_led_mc_rgb(struct vled_device_data *dev_data)
+{
+    struct led_classdev_mc *mc = &dev_data->led_mc;
+    u32 rgb = 0;
+    int i;
     
-    mutex_lock(&dev_data->lock);
-    snprintf(state_info, sizeof(state_info), 
-             "LED State: %s\nBrightness: %d\nColor: %s\n",
-             dev_data->led_state ? "ON" : "OFF",
-             dev_data->brightness,
-             dev_data->color);
-    mutex_unlock(&dev_data->lock);
+    led_mc_calc_color_components(mc, mc->led_cdev.max_brightness);
+    for (i = 0; i < 3; i++)
+        rgb = rgb << 8 | min_t(u32, dev_data->led_subleds[i].brightness, LED_FULL);
+    return rgb;
+}
+#else
+static struct led_classdev *vled_led_cdev(struct vled_device_data *dev_data)
+{
+    return &dev_data->led_cdev;
+}
+
+static struct vled_device_data *vled_led_dev(struct led_classdev *cdev)
+{
+    return container_of(cdev, struct vled_device_data, led_cdev);
+}
+#endif
+
+static int vled_led_brightness_set(struct led_classdev *cdev, enum led_brightness value)
+{
+    struct vled_device_data *dev_data = vled_led_dev(cdev);
+    struct vled_state st = { .mask = VLED_SET_LED_STATE };
+
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+    // Все каналы погашены - цвет не меняется
+    st.rgb = vled_led_mc_rgb(dev_data);
+    if (st.rgb)
+        st.mask |= VLED_SET_RGB;
+#endif
+
+    // По соглашению подсистемы LED нулевая яркость отключает аппаратное мигание
+    if (value == LED_OFF) {
+        static const struct vled_effect none = { .type = VLED_EFFECT_NONE };
+        
+        mutex_lock(&dev_data->effect_lock);
+        if (dev_data->led_hw_blink) {
+            dev_data->led_hw_blink = false;
+            vled_effect_start_locked(dev_data, &none);
+        }
+        mutex_unlock(&dev_data->effect_lock);
+    }
     
-    bytes_to_copy = strlen(state_info);
-    if (len < bytes_to_copy)
-        return -EFAULT;
+    st.led_state = value != LED_OFF;
+    if (value != LED_OFF) {
+        st.mask |= VLED_SET_BRIGHTNESS;
+        st.brightness = value;
+    }
     
-    if (copy_to_user(buffer, state_info, bytes_to_copy))
-        return -EFAULT;
+    vled_update_begin(dev_data);
+    vled_update_end(dev_data, vled_state_apply(dev_data, &st), VLED_SRC_LEDCLASS);
+    return 0;
+}
+
+static enum led_brightness vled_led_brightness_get(struct led_classdev *cdev)
+{
+    struct vled_state st;
     
-    *offset = bytes_to_copy;
-    return bytes_to_copy;
+    vled_snapshot(vled_led_dev(cdev), &st);
+    return st.led_state ? st.brightness : LED_OFF;
 }
 
-static ssize_t vled_write(struct file *filep, const char *buffer, size_t len, loff_t *offset)
+// Аппаратное мигание реализуется движком эффектов
+static int vled_led_blink_set(struct led_classdev *cdev,
+                              unsigned long *delay_on, unsigned long *delay_off)
 {
-    struct vled_device_data *dev_data = filep->private_data;
-    char cmd[256];
+    struct vled_device_data *dev_data = vled_led_dev(cdev);
+    struct vled_effect eff = { .type = VLED_EFFECT_BLINK };
+    int retval;
     
-    if (len > 255)
-        return -EINVAL;
+    if (*delay_on == 0 && *delay_off == 0)
+        *delay_on = *delay_off = 500;
+    if (*delay_on == 0 || *delay_off == 0 || *delay_on > U32_MAX || *delay_off > U32_MAX)
+        return -EINVAL;     // Ядро перейдет на программное мигание
     
-    if (copy_from_user(cmd, buffer, len))
-        return -EFAULT;
+    eff.blink.on_ms = *delay_on;
+    eff.blink.off_ms = *delay_off;
+    retval = vled_effect_validate(&eff);
+    if (retval)
+        return retval;
     
-    cmd[len] = '\0';
+    mutex_lock(&dev_data->effect_lock);
+    vled_effect_start_locked(dev_data, &eff);
+    dev_data->led_hw_blink = true;
+    mutex_unlock(&dev_data->effect_lock);
+    return 0;
+}
+
+static int vled_led_register(struct vled_device_data *dev_data, unsigned int index)
+{
+    struct led_classdev *cdev = vled_led_cdev(dev_data);
+    struct vled_state st;
+    int retval;
     
-    mutex_lock(&dev_data->lock);
+    vled_snapshot(dev_data, &st);
     
-    // Обработка команд
-    if (strncmp(cmd, "ON", 2) == 0) {
-        dev_data->led_state = 1;
-        printk(KERN_INFO "Virtual LED: Turned ON\n");
-    } else if (strncmp(cmd, "OFF", 3) == 0) {
-        dev_data->led_state = 0;
-        printk(KERN_INFO "Virtual LED: Turned OFF\n");
-    } else if (strncmp(cmd, "BRIGHTNESS ", 11) == 0) {
-        int brightness;
-        if (sscanf(cmd + 11, "%d", &brightness) == 1) {
-            if (brightness >= 0 && brightness <= 255) {
-                dev_data->brightness = brightness;
-                printk(KERN_INFO "Virtual LED: Brightness set to %d\n", brightness);
-            }
-        }
-    } else if (strncmp(cmd, "COLOR ", 6) == 0) {
-        char color[16];
-        if (sscanf(cmd + 6, "%15s", color) == 1) {
-            strncpy(dev_data->color, color, sizeof(dev_data->color) - 1);
-            dev_data->color[sizeof(dev_data->color) - 1] = '\0';
-            printk(KERN_INFO "Virtual LED: Color set to %s\n", color);
+    cdev->max_brightness = LED_FULL;
+    cdev->brightness = st.led_state ? st.brightness : LED_OFF;
+    cdev->brightness_set_blocking = vled_led_brightness_set;
+    cdev->brightness_get = vled_led_brightness_get;
+    cdev->blink_set = vled_led_blink_set;
+
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+    {
+        static const int ids[3] = { LED_COLOR_ID_RED, LED_COLOR_ID_GREEN, LED_COLOR_ID_BLUE };
+        int i;
+        
+        for (i = 0; i < 3; i++) {
+            dev_data->led_subleds[i].color_index = ids[i];
+            dev_data->led_subleds[i].intensity = (st.rgb >> (16 - 8 * i)) & 0xff;
         }
+        dev_data->led_mc.subled_info = dev_data->led_subleds;
+        dev_data->led_mc.num_colors = 3;
+        snprintf(dev_data->led_name, sizeof(dev_data->led_name),
+                 DEVICE_NAME "%u:multicolor:indicator", index);
+        cdev->name = dev_data->led_name;
+        retval = led_classdev_multicolor_register(dev_data->dev, &dev_data->led_mc);
     }
+#else
+    snprintf(dev_data->led_name, sizeof(dev_data->led_name),
+             DEVICE_NAME "%u::indicator", index);
+    cdev->name = dev_data->led_name;
+    retval = led_classdev_register(dev_data->dev, cdev);
+#endif
+
+    dev_data->led_registered = !retval;
+    return retval;
+}
+
+static void vled_led_unregister(struct vled_device_data *dev_data)
+{
+    if (!dev_data->led_registered)
+        return;
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+    led_classdev_multicolor_unregister(&dev_data->led_mc);
+#else
+    led_classdev_unregister(&dev_data->led_cdev);
+#endif
+    dev_data->led_registered = false;
+}
+#else
+static int vled_led_register(struct vled_device_data *dev_data, unsigned int index)
+{
+    return 0;
+}
+
+static void vled_led_unregister(struct vled_device_data *dev_data)
+{
+}
+#endif
+
+// Функции для sysfs атрибутов. Разбор и формат значений - общее ядро
+// (vled_core.h), здесь только снимок, публикация и трассировка.
+static ssize_t vled_attr_show_common(struct device *dev, enum vled_attr attr, char *buf)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(dev);
+    union vled_packed s;
     
-    mutex_unlock(&dev_data->lock);
-    return len;
+    vled_snapshot_packed(dev_data, &s);
+    return vled_attr_show(s, attr, buf, PAGE_SIZE);
 }
 
-// Операции файловых операций
-static struct file_operations fops = {
-    .owner = THIS_MODULE,
-    .open = vled_open,
-    .read = vled_read,
-    .write = vled_write,
-    .release = vled_release,
-};
+static int vled_attr_store_common(struct device *dev, enum vled_attr attr, const char *buf)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(dev);
+    struct vled_state st;
+    int retval;
+    
+    trace_vled_command(vled_index(dev_data), VLED_SRC_SYSFS, buf);
+    retval = vled_attr_parse(attr, buf, &st);
+    if (retval) {
+        trace_vled_command_rejected(vled_index(dev_data), VLED_SRC_SYSFS, buf, retval);
+        return retval;
+    }
+    
+    vled_update_begin(dev_data);
+    vled_update_end(dev_data, vled_state_apply(dev_data, &st), VLED_SRC_SYSFS);
+    vled_log("%s changed to %.*s via sysfs\n", vled_attr_names[attr],
+             (int)strcspn(buf, "\n"), buf);
+    return 0;
+}
 
-// Функции для sysfs атрибутов
 static ssize_t led_state_show(struct device *dev, 
                              struct device_attribute *attr, 
                              char *buf)
 {
-    return sprintf(buf, "%d\n", device_data.led_state);
+    return vled_attr_show_common(dev, VLED_ATTR_LED_STATE, buf);
 }
 
 static ssize_t led_state_store(struct device *dev,
                               struct device_attribute *attr,
                               const char *buf, size_t count)
 {
-    int state;
-    if (sscanf(buf, "%d", &state) == 1) {
-        if (state == 0 || state == 1) {
-            mutex_lock(&device_data.lock);
-            device_data.led_state = state;
-            mutex_unlock(&device_data.lock);
-            printk(KERN_INFO "Virtual LED: State changed to %d via sysfs\n", state);
-        }
-    }
+    vled_attr_store_common(dev, VLED_ATTR_LED_STATE, buf);
     return count;
 }
 
@@ -167,22 +1687,14 @@ static ssize_t brightness_show(struct device *dev,
                               struct device_attribute *attr,
                               char *buf)
 {
-    return sprintf(buf, "%d\n", device_data.brightness);
+    return vled_attr_show_common(dev, VLED_ATTR_BRIGHTNESS, buf);
 }
 
 static ssize_t brightness_store(struct device *dev,
                                struct device_attribute *attr,
                                const char *buf, size_t count)
 {
-    int brightness;
-    if (sscanf(buf, "%d", &brightness) == 1) {
-        if (brightness >= 0 && brightness <= 255) {
-            mutex_lock(&device_data.lock);
-            device_data.brightness = brightness;
-            mutex_unlock(&device_data.lock);
-            printk(KERN_INFO "Virtual LED: Brightness changed to %d via sysfs\n", brightness);
-        }
-    }
+    vled_attr_store_common(dev, VLED_ATTR_BRIGHTNESS, buf);
     return count;
 }
 
@@ -190,59 +1702,379 @@ static ssize_t color_show(struct device *dev,
                          struct device_attribute *attr,
                          char *buf)
 {
-    return sprintf(buf, "%s\n", device_data.color);
+    return vled_attr_show_common(dev, VLED_ATTR_COLOR, buf);
 }
 
 static ssize_t color_store(struct device *dev,
                           struct device_attribute *attr,
                           const char *buf, size_t count)
 {
-    char new_color[16];
-    if (sscanf(buf, "%15s", new_color) == 1) {
-        mutex_lock(&device_data.lock);
-        strncpy(device_data.color, new_color, sizeof(device_data.color) - 1);
-        device_data.color[sizeof(device_data.color) - 1] = '\0';
-        mutex_unlock(&device_data.lock);
-        printk(KERN_INFO "Virtual LED: Color changed to %s via sysfs\n", new_color);
-    }
+    vled_attr_store_common(dev, VLED_ATTR_COLOR, buf);
     return count;
 }
 
+// Цвет числом: чтение - rrggbb, запись - шестнадцатеричное значение до ffffff.
+// В отличие от остальных атрибутов неверное значение возвращает ошибку.
+static ssize_t rgb_show(struct device *dev,
+                       struct device_attribute *attr,
+                       char *buf)
+{
+    return vled_attr_show_common(dev, VLED_ATTR_RGB, buf);
+}
+
+static ssize_t rgb_store(struct device *dev,
+                        struct device_attribute *attr,
+                        const char *buf, size_t count)
+{
+    int retval = vled_attr_store_common(dev, VLED_ATTR_RGB, buf);
+    return retval ? retval : count;
+}
+
+static ssize_t effect_show(struct device *dev,
+                          struct device_attribute *attr,
+                          char *buf)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(dev);
+    struct vled_effect eff;
+    
+    vled_effect_get(dev_data, &eff);
+    return vled_effect_format(&eff, buf);
+}
+
+static ssize_t effect_store(struct device *dev,
+                           struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(dev);
+    struct vled_effect eff;
+    char *text;
+    int retval;
+    
+    text = kstrndup(buf, count, GFP_KERNEL);
+    if (!text)
+        return -ENOMEM;
+    retval = vled_effect_parse(text, &eff);
+    kfree(text);
+    if (retval)
+        return retval;
+    
+    retval = vled_effect_start(dev_data, &eff);
+    return retval ? retval : count;
+}
+
+// Все поля и версия одним чтением из одного снимка, в формате VLED_FORMAT_KV.
+// Дескриптор можно держать открытым: pread() с позиции 0 берет новый снимок.
+static ssize_t state_show(struct device *dev,
+                         struct device_attribute *attr,
+                         char *buf)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(dev);
+    union vled_packed s;
+    unsigned int seq = vled_snapshot_packed(dev_data, &s);
+    
+    return vled_state_render(s, seq, VLED_FORMAT_KV, buf, PAGE_SIZE);
+}
+
+// С 6.13 bin_attribute передается как const. На время перехода (6.13-6.16)
+// такие обработчики подключались через read_new и bin_attrs_new, с 6.17 -
+// снова через read и bin_attrs.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+#define VLED_BIN_ATTR_CONST const
+#else
+#define VLED_BIN_ATTR_CONST
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0) && LINUX_VERSION_CODE < KERNEL_VERSION(6, 17, 0)
+#define VLED_BIN_ATTR_NEW
+#endif
+
+// То же в двоичном виде: struct vled_state_record
+static ssize_t state_raw_read(struct file *filep, struct kobject *kobj,
+                              VLED_BIN_ATTR_CONST struct bin_attribute *attr,
+                              char *buf, loff_t off, size_t count)
+{
+    struct vled_device_data *dev_data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct vled_state_record rec;
+    union vled_packed s;
+    unsigned int seq = vled_snapshot_packed(dev_data, &s);
+    
+    vled_state_render(s, seq, VLED_FORMAT_BINARY, (char *)&rec, sizeof(rec));
+    return memory_read_from_buffer(buf, count, &off, &rec, sizeof(rec));
+}
+
 // Определение sysfs атрибутов
 static DEVICE_ATTR(led_state, 0664, led_state_show, led_state_store);
 static DEVICE_ATTR(brightness, 0664, brightness_show, brightness_store);
 static DEVICE_ATTR(color, 0664, color_show, color_store);
+static DEVICE_ATTR(rgb, 0664, rgb_show, rgb_store);
+static DEVICE_ATTR(effect, 0664, effect_show, effect_store);
+static DEVICE_ATTR_RO(state);
+
+static struct bin_attribute bin_attr_state_raw = {
+    .attr = { .name = "state_raw", .mode = 0444 },
+    .size = sizeof(struct vled_state_record),
+#ifdef VLED_BIN_ATTR_NEW
+    .read_new = state_raw_read,
+#else
+    .read = state_raw_read,
+#endif
+};
 
 static struct attribute *vled_attrs[] = {
     &dev_attr_led_state.attr,
     &dev_attr_brightness.attr,
     &dev_attr_color.attr,
+    &dev_attr_rgb.attr,
+    &dev_attr_effect.attr,
+    &dev_attr_state.attr,
+    NULL,
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+static const struct bin_attribute *const vled_bin_attrs[] = {
+#else
+static struct bin_attribute *vled_bin_attrs[] = {
+#endif
+    &bin_attr_state_raw,
     NULL,
 };
 
 static struct attribute_group vled_attr_group = {
     .attrs = vled_attrs,
+#ifdef VLED_BIN_ATTR_NEW
+    .bin_attrs_new = vled_bin_attrs,
+#else
+    .bin_attrs = vled_bin_attrs,
+#endif
+};
+
+static const struct attribute_group *vled_attr_groups[] = {
+    &vled_attr_group,
+    NULL,
+};
+
+// Статистика в debugfs: /sys/kernel/debug/vled/vledN/stats и reset.
+// Значения суммируются по всем CPU при чтении; сброс не синхронизирован
+// с писателями, поэтому параллельные приращения могут сохраниться.
+static const char *const vled_stat_names[VLED_STAT_COUNT] = {
+    [VLED_STAT_OPENS]     = "opens",
+    [VLED_STAT_READS]     = "reads",
+    [VLED_STAT_WRITES]    = "writes",
+    [VLED_STAT_IOCTLS]    = "ioctls",
+    [VLED_STAT_REJECTED]  = "rejected",
+    [VLED_STAT_CONTENDED] = "lock_contended",
+};
+
+static const char *const vled_hist_names[VLED_HIST_COUNT] = {
+    [VLED_HIST_WRITE]     = "write_ns",
+    [VLED_HIST_LOCK_WAIT] = "lock_wait_ns",
+    [VLED_HIST_SNAPSHOT]  = "snapshot_ns",
+};
+
+static int vled_stats_show(struct seq_file *m, void *v)
+{
+    struct vled_device_data *dev_data = m->private;
+    u64 hist[VLED_HIST_BUCKETS];
+    unsigned int i, b;
+    int cpu;
+    
+    for (i = 0; i < VLED_STAT_COUNT; i++) {
+        u64 sum = 0;
+        for_each_possible_cpu(cpu)
+            sum += per_cpu_ptr(dev_data->stats, cpu)->counters[i];
+        seq_printf(m, "%s %llu\n", vled_stat_names[i], sum);
+    }
+    
+    // Для каждой непустой корзины: верхняя граница в нс и число событий
+    for (i = 0; i < VLED_HIST_COUNT; i++) {
+        memset(hist, 0, sizeof(hist));
+        for_each_possible_cpu(cpu)
+            for (b = 0; b < VLED_HIST_BUCKETS; b++)
+                hist[b] += per_cpu_ptr(dev_data->stats, cpu)->hist[i][b];
+        
+        seq_printf(m, "\n%s\n", vled_hist_names[i]);
+        for (b = 0; b < VLED_HIST_BUCKETS; b++) {
+            if (!hist[b])
+                continue;
+            if (b == VLED_HIST_BUCKETS - 1)
+                seq_printf(m, "  >= %-10llu %llu\n", 1ULL << (b - 1), hist[b]);
+            else
+                seq_printf(m, "  <  %-10llu %llu\n", 1ULL << b, hist[b]);
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(vled_stats);
+
+// Любая запись в reset обнуляет статистику светодиода
+static ssize_t vled_stats_reset_write(struct file *filep, const char __user *buffer,
+                                      size_t len, loff_t *offset)
+{
+    struct vled_device_data *dev_data = file_inode(filep)->i_private;
+    int cpu;
+    
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(dev_data->stats, cpu), 0, sizeof(struct vled_stats));
+    return len;
+}
+
+static const struct file_operations vled_stats_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = vled_stats_reset_write,
+    .llseek = noop_llseek,
 };
 
+// Ошибки debugfs не мешают работе драйвера и не проверяются
+static void vled_debugfs_add(struct vled_device_data *dev_data, unsigned int index)
+{
+    char name[16];
+    
+    snprintf(name, sizeof(name), DEVICE_NAME "%u", index);
+    dev_data->debugfs = debugfs_create_dir(name, vled_debugfs_root);
+    debugfs_create_file("stats", 0444, dev_data->debugfs, dev_data, &vled_stats_fops);
+    debugfs_create_file("reset", 0200, dev_data->debugfs, dev_data, &vled_stats_reset_fops);
+}
+
+// Инициализация одного светодиода: состояние, страница mmap, журнал и узлы
+static int vled_device_setup(unsigned int index)
+{
+    struct vled_device_data *dev_data = &vled_devices[index];
+    dev_t dev_num = MKDEV(major_number, index);
+    dev_t events_num = MKDEV(major_number, num_devices + index);
+    struct device *dev;
+    int retval;
+    
+    mutex_init(&dev_data->lock);
+    mutex_init(&dev_data->effect_lock);
+    seqcount_mutex_init(&dev_data->seq, &dev_data->lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&dev_data->effect_timer, vled_effect_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+    hrtimer_init(&dev_data->effect_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    dev_data->effect_timer.function = vled_effect_timer_fn;
+#endif
+    INIT_WORK(&dev_data->effect_work, vled_effect_work_fn);
+    init_waitqueue_head(&dev_data->wq);
+    atomic_long_set(&dev_data->events_head, 0);
+    dev_data->state = vled_initial_state();
+    
+    dev_data->shared = (struct vled_shared_page *)get_zeroed_page(GFP_KERNEL);
+    if (!dev_data->shared)
+        return -ENOMEM;
+    dev_data->shared->abi_version = VLED_ABI_VERSION;
+    vled_publish(dev_data);
+    
+    dev_data->events = kvcalloc(VLED_EVENTS_SIZE, sizeof(*dev_data->events), GFP_KERNEL);
+    if (!dev_data->events) {
+        retval = -ENOMEM;
+        goto err_free_page;
+    }
+    
+    if (vled_stats_enabled) {
+        dev_data->stats = alloc_percpu(struct vled_stats);
+        if (!dev_data->stats) {
+            retval = -ENOMEM;
+            goto err_free_events;
+        }
+    }
+    
+    // Устройство с атрибутами sysfs создается атомарно, до события uevent
+    dev = device_create_with_groups(vled_class, NULL, dev_num, dev_data,
+                                    vled_attr_groups, DEVICE_NAME "%u", index);
+    if (IS_ERR(dev)) {
+        retval = PTR_ERR(dev);
+        goto err_free_stats;
+    }
+    WRITE_ONCE(dev_data->dev, dev);
+    
+    dev_data->events_dev = device_create(vled_class, NULL, events_num, dev_data,
+                                         DEVICE_NAME "%u" EVENTS_SUFFIX, index);
+    if (IS_ERR(dev_data->events_dev)) {
+        retval = PTR_ERR(dev_data->events_dev);
+        goto err_device;
+    }
+    
+    if (led_class) {
+        retval = vled_led_register(dev_data, index);
+        if (retval)
+            goto err_events_device;
+    }
+    
+    if (dev_data->stats)
+        vled_debugfs_add(dev_data, index);
+    
+    return 0;
+    
+err_events_device:
+    device_destroy(vled_class, events_num);
+err_device:
+    vled_effect_stop(dev_data);
+    WRITE_ONCE(dev_data->dev, NULL);
+    device_destroy(vled_class, dev_num);
+err_free_stats:
+    free_percpu(dev_data->stats);
+err_free_events:
+    kvfree(dev_data->events);
+err_free_page:
+    free_page((unsigned long)dev_data->shared);
+    return retval;
+}
+
+static void vled_device_teardown(unsigned int index)
+{
+    struct vled_device_data *dev_data = &vled_devices[index];
+    
+    // Шаг эффекта уведомляет sysfs, поэтому эффект останавливается до удаления
+    // устройства. До удаления атрибутов его может снова запустить запись в
+    // effect: повторная остановка уже не тронет устройство (dev_data->dev == NULL).
+    vled_effect_stop(dev_data);
+    debugfs_remove_recursive(dev_data->debugfs);
+    vled_led_unregister(dev_data);
+    device_destroy(vled_class, MKDEV(major_number, num_devices + index));
+    WRITE_ONCE(dev_data->dev, NULL);
+    device_destroy(vled_class, MKDEV(major_number, index));
+    vled_effect_stop(dev_data);
+    free_percpu(dev_data->stats);
+    kvfree(dev_data->events);
+    free_page((unsigned long)dev_data->shared);
+    mutex_destroy(&dev_data->effect_lock);
+    mutex_destroy(&dev_data->lock);
+}
+
 // Инициализация устройства
 static int __init vled_init(void)
 {
     dev_t dev_num;
+    unsigned int i;
     int retval;
     
     printk(KERN_INFO "Virtual LED Driver v2.2: Initializing...\n");
     
-    // Инициализация данных устройства
-    mutex_init(&device_data.lock);
-    device_data.led_state = 0;
-    device_data.brightness = 128;
-    strcpy(device_data.color, "green");
+    if (num_devices < 1 || num_devices > MAX_DEVICES) {
+        printk(KERN_ALERT "num_devices must be in 1..%d\n", MAX_DEVICES);
+        return -EINVAL;
+    }
+    
+    if (led_class && !IS_ENABLED(CONFIG_LEDS_CLASS)) {
+        printk(KERN_WARNING "Virtual LED Driver: led_class requested but CONFIG_LEDS_CLASS is disabled\n");
+        led_class = false;
+    }
+    
+    vled_devices = kvcalloc(num_devices, sizeof(*vled_devices), GFP_KERNEL);
+    if (!vled_devices)
+        return -ENOMEM;
+    
+    vled_effect_wq = alloc_workqueue("vled_effects", WQ_HIGHPRI, 0);
+    if (!vled_effect_wq) {
+        retval = -ENOMEM;
+        goto err_free_devices;
+    }
     
-    // Динамическое выделение major номера
-    retval = alloc_chrdev_region(&dev_num, 0, MAX_DEVICES, DEVICE_NAME);
+    // Динамическое выделение major номера, по два младших номера на светодиод
+    retval = alloc_chrdev_region(&dev_num, 0, 2 * num_devices, DEVICE_NAME);
     if (retval < 0) {
         printk(KERN_ALERT "Failed to allocate character device region\n");
-        return retval;
+        goto err_destroy_wq;
     }
     
     major_number = MAJOR(dev_num);
@@ -255,79 +2087,92 @@ static int __init vled_init(void)
     vled_class = class_create(THIS_MODULE, CLASS_NAME);
 #endif
     if (IS_ERR(vled_class)) {
-        unregister_chrdev_region(dev_num, MAX_DEVICES);
         printk(KERN_ALERT "Failed to create device class\n");
-        return PTR_ERR(vled_class);
+        retval = PTR_ERR(vled_class);
+        goto err_unregister;
     }
     
-    // Создание устройства
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
-    vled_device = device_create(vled_class, NULL, dev_num, NULL, "%s", DEVICE_NAME);
-#else
-    vled_device = device_create(vled_class, NULL, dev_num, NULL, DEVICE_NAME);
-#endif
-    if (IS_ERR(vled_device)) {
-        class_destroy(vled_class);
-        unregister_chrdev_region(dev_num, MAX_DEVICES);
-        printk(KERN_ALERT "Failed to create device\n");
-        return PTR_ERR(vled_device);
-    }
+    if (vled_stats_enabled)
+        vled_debugfs_root = debugfs_create_dir(CLASS_NAME, NULL);
     
-    // Создание sysfs атрибутов
-    retval = sysfs_create_group(&vled_device->kobj, &vled_attr_group);
-    if (retval) {
-        device_destroy(vled_class, dev_num);
-        class_destroy(vled_class);
-        unregister_chrdev_region(dev_num, MAX_DEVICES);
-        printk(KERN_ALERT "Failed to create sysfs group\n");
-        return retval;
+    // Создание светодиодов
+    for (i = 0; i < num_devices; i++) {
+        retval = vled_device_setup(i);
+        if (retval) {
+            printk(KERN_ALERT "Failed to create device %u\n", i);
+            goto err_devices;
+        }
     }
     
-    // Инициализация cdev
+    // Статистика выделена для всех светодиодов, сбор можно включать
+    if (vled_stats_enabled)
+        static_branch_enable(&vled_stats_key);
+    
+    // Добавление cdev в систему: по одному на каждый тип узла
     cdev_init(&vled_cdev, &fops);
     vled_cdev.owner = THIS_MODULE;
-    
-    // Добавление cdev в систему
-    retval = cdev_add(&vled_cdev, dev_num, MAX_DEVICES);
+    retval = cdev_add(&vled_cdev, dev_num, num_devices);
     if (retval) {
-        sysfs_remove_group(&vled_device->kobj, &vled_attr_group);
-        device_destroy(vled_class, dev_num);
-        class_destroy(vled_class);
-        unregister_chrdev_region(dev_num, MAX_DEVICES);
         printk(KERN_ALERT "Failed to add character device\n");
-        return retval;
+        goto err_devices;
+    }
+    
+    cdev_init(&vled_events_cdev, &events_fops);
+    vled_events_cdev.owner = THIS_MODULE;
+    retval = cdev_add(&vled_events_cdev, MKDEV(major_number, num_devices), num_devices);
+    if (retval) {
+        printk(KERN_ALERT "Failed to add events character device\n");
+        goto err_cdev;
     }
     
     printk(KERN_INFO "Virtual LED Driver: Successfully initialized\n");
-    printk(KERN_INFO "Device node: /dev/%s\n", DEVICE_NAME);
-    printk(KERN_INFO "Sysfs path: /sys/class/%s/%s/\n", CLASS_NAME, DEVICE_NAME);
+    printk(KERN_INFO "Devices: %u\n", num_devices);
+    printk(KERN_INFO "Device nodes: /dev/%s0..%u\n", DEVICE_NAME, num_devices - 1);
+    printk(KERN_INFO "Sysfs path: /sys/class/%s/%sN/\n", CLASS_NAME, DEVICE_NAME);
     printk(KERN_INFO "Kernel version: %u (6.12.48)\n", LINUX_VERSION_CODE);
     
     return 0;
+    
+err_cdev:
+    cdev_del(&vled_cdev);
+err_devices:
+    while (i--)
+        vled_device_teardown(i);
+    debugfs_remove_recursive(vled_debugfs_root);
+    class_destroy(vled_class);
+err_unregister:
+    unregister_chrdev_region(dev_num, 2 * num_devices);
+err_destroy_wq:
+    destroy_workqueue(vled_effect_wq);
+err_free_devices:
+    kvfree(vled_devices);
+    return retval;
 }
 
 static void __exit vled_exit(void)
 {
     dev_t dev_num = MKDEV(major_number, 0);
+    unsigned int i;
     
     printk(KERN_INFO "Virtual LED Driver: Exiting...\n");
     
-    // Удаление sysfs атрибутов
-    sysfs_remove_group(&vled_device->kobj, &vled_attr_group);
-    
     // Удаление cdev
+    cdev_del(&vled_events_cdev);
     cdev_del(&vled_cdev);
     
-    // Удаление устройства
-    device_destroy(vled_class, dev_num);
+    // Удаление устройств
+    for (i = num_devices; i-- > 0; )
+        vled_device_teardown(i);
+    debugfs_remove_recursive(vled_debugfs_root);
     
     // Удаление класса
     class_destroy(vled_class);
     
-    // Освобождение номера устройства
-    unregister_chrdev_region(dev_num, MAX_DEVICES);
+    // Освобождение номеров устройств
+    unregister_chrdev_region(dev_num, 2 * num_devices);
     
-    mutex_destroy(&device_data.lock);
+    destroy_workqueue(vled_effect_wq);
+    kvfree(vled_devices);
     
     printk(KERN_INFO "Virtual LED Driver: Successfully unloaded\n");
 }
@@ -0,0 +1,419 @@
+#ifndef _VLED_CORE_H
+#define _VLED_CORE_H
+
+// Общее ядро драйвера: текстовые команды, атрибуты и переходы состояния.
+// Функции работают только с копией состояния и не знают о блокировках,
+// уведомлениях и копировании из пространства пользователя, поэтому один и
+// тот же код собирается в модуль ядра и в симулятор vled_sim.
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+#include "vled_ioctl.h"
+
+// Палитра именованных цветов в порядке enum vled_color_index, общая для
+// драйвера и программ: имя переводится в RGB по этой таблице, а RGB из
+// палитры показывается ее именем
+static const struct {
+    const char *name;
+    __u32 rgb;
+} vled_palette[VLED_COLOR_COUNT] = {
+    [VLED_COLOR_RED]     = { "red",     0xff0000 },
+    [VLED_COLOR_GREEN]   = { "green",   0x00ff00 },
+    [VLED_COLOR_BLUE]    = { "blue",    0x0000ff },
+    [VLED_COLOR_YELLOW]  = { "yellow",  0xffff00 },
+    [VLED_COLOR_WHITE]   = { "white",   0xffffff },
+    [VLED_COLOR_CYAN]    = { "cyan",    0x00ffff },
+    [VLED_COLOR_MAGENTA] = { "magenta", 0xff00ff },
+};
+
+// Индекс палитры для RGB, VLED_COLOR_CUSTOM - цвет вне палитры
+static inline __u32 vled_palette_index(__u32 rgb)
+{
+    __u32 i;
+    
+    for (i = 0; i < VLED_COLOR_COUNT; i++)
+        if (vled_palette[i].rgb == rgb)
+            return i;
+    return VLED_COLOR_CUSTOM;
+}
+
+// Разбор имени из палитры или "#rrggbb"; 0 при успехе, -1 - неизвестный цвет
+static inline int vled_color_parse(const char *name, __u32 *rgb)
+{
+    __u32 i, value = 0;
+    
+    if (name[0] == '#') {
+        for (i = 1; i <= 6; i++) {
+            char c = name[i];
+            if (c >= '0' && c <= '9')
+                value = value << 4 | (__u32)(c - '0');
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                value = value << 4 | (__u32)((c | 0x20) - 'a' + 10);
+            else
+                return -1;
+        }
+        if (name[7] != '\0')
+            return -1;
+        *rgb = value;
+        return 0;
+    }
+    
+    for (i = 0; i < VLED_COLOR_COUNT; i++) {
+        if (strcmp(name, vled_palette[i].name) == 0) {
+            *rgb = vled_palette[i].rgb;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Состояние светодиода в одном 64-битном слове: писатель заменяет его одной
+// записью, читатель получает все поля одним чтением
+union vled_packed {
+    struct {
+        __u32 rgb;          // 0x00RRGGBB
+        __u8 color_index;   // enum vled_color_index, производный от rgb
+        __u8 brightness;    // Яркость 0-255
+        __u8 led_state;     // 0 - выключен, 1 - включен
+        __u8 reserved;
+    };
+    __u64 word;
+};
+
+// Атрибуты устройства (sysfs в модуле, файлы каталога в симуляторе).
+// Первые VLED_ATTR_COUNT изменяемые, за ними - только для чтения.
+enum vled_attr {
+    VLED_ATTR_LED_STATE,
+    VLED_ATTR_BRIGHTNESS,
+    VLED_ATTR_COLOR,
+    VLED_ATTR_RGB,
+    VLED_ATTR_COUNT,
+    VLED_ATTR_STATE = VLED_ATTR_COUNT,  // Сводное состояние в тексте
+    VLED_ATTR_STATE_RAW,                // struct vled_state_record
+    VLED_ATTR_ALL,
+};
+
+static const char *const vled_attr_names[VLED_ATTR_ALL] = {
+    [VLED_ATTR_LED_STATE]  = "led_state",
+    [VLED_ATTR_BRIGHTNESS] = "brightness",
+    [VLED_ATTR_COLOR]      = "color",
+    [VLED_ATTR_RGB]        = "rgb",
+    [VLED_ATTR_STATE]      = "state",
+    [VLED_ATTR_STATE_RAW]  = "state_raw",
+};
+
+static inline void vled_packed_set_rgb(union vled_packed *s, __u32 rgb)
+{
+    s->rgb = rgb;
+    s->color_index = vled_palette_index(rgb);
+}
+
+// Начальное состояние светодиода: выключен, яркость 128, зеленый
+static inline union vled_packed vled_initial_state(void)
+{
+    union vled_packed s = { .word = 0 };
+    
+    s.brightness = 128;
+    vled_packed_set_rgb(&s, vled_palette[VLED_COLOR_GREEN].rgb);
+    return s;
+}
+
+// Текстовая форма цвета: имя из палитры или #rrggbb
+static inline void vled_color_format(union vled_packed s, char *buf)
+{
+    if (s.color_index < VLED_COLOR_COUNT)
+        snprintf(buf, VLED_COLOR_LEN, "%s", vled_palette[s.color_index].name);
+    else
+        snprintf(buf, VLED_COLOR_LEN, "#%06x", s.rgb);
+}
+
+static inline void vled_packed_to_state(union vled_packed s, struct vled_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->mask = VLED_SET_ALL;
+    st->led_state = s.led_state;
+    st->brightness = s.brightness;
+    st->rgb = s.rgb;
+    vled_color_format(s, st->color);
+}
+
+// Текст, возвращаемый read() устройства
+static inline int vled_state_format(union vled_packed s, char *buf, size_t size)
+{
+    char color[VLED_COLOR_LEN];
+    
+    vled_color_format(s, color);
+    return snprintf(buf, size, "LED State: %s\nBrightness: %u\nColor: %s\n",
+                    s.led_state ? "ON" : "OFF", s.brightness, color);
+}
+
+// Запись read() в формате VLED_FORMAT_*; длина или -EINVAL
+#define VLED_READ_MAX 128
+
+static inline int vled_state_render(union vled_packed s, __u32 seq, __u32 format,
+                                    char *buf, size_t size)
+{
+    struct vled_state_record rec;
+    char color[VLED_COLOR_LEN];
+    
+    vled_color_format(s, color);
+    switch (format) {
+    case VLED_FORMAT_TEXT:
+        return vled_state_format(s, buf, size);
+    case VLED_FORMAT_KV:
+        return snprintf(buf, size, "led_state=%u\nbrightness=%u\ncolor=%s\nrgb=%06x\nseq=%u\n",
+                        s.led_state, s.brightness, color, s.rgb, seq);
+    case VLED_FORMAT_JSON:
+        return snprintf(buf, size, "{\"led_state\":%u,\"brightness\":%u,\"color\":\"%s\","
+                        "\"rgb\":\"%06x\",\"seq\":%u}\n",
+                        s.led_state, s.brightness, color, s.rgb, seq);
+    case VLED_FORMAT_BINARY:
+        if (size < sizeof(rec))
+            return -EINVAL;
+        memset(&rec, 0, sizeof(rec));
+        rec.seq = seq;
+        vled_packed_to_state(s, &rec.state);
+        memcpy(buf, &rec, sizeof(rec));
+        return sizeof(rec);
+    default:
+        return -EINVAL;
+    }
+}
+
+// Проверка всех полей до применения, чтобы не получить частичное обновление
+static inline int vled_state_validate(const struct vled_state *st)
+{
+    __u32 rgb;
+    
+    if (st->mask & ~(VLED_SET_ALL | VLED_SET_RGB))
+        return -EINVAL;
+    if ((st->mask & VLED_SET_COLOR) && (st->mask & VLED_SET_RGB))
+        return -EINVAL;
+    if ((st->mask & VLED_SET_RGB) && st->rgb > VLED_RGB_MAX)
+        return -EINVAL;
+    if ((st->mask & VLED_SET_LED_STATE) && st->led_state > 1)
+        return -EINVAL;
+    if ((st->mask & VLED_SET_BRIGHTNESS) && st->brightness > 255)
+        return -EINVAL;
+    if ((st->mask & VLED_SET_COLOR) &&
+        (strnlen(st->color, sizeof(st->color)) == sizeof(st->color) ||
+         vled_color_parse(st->color, &rgb)))
+        return -EINVAL;
+    return 0;
+}
+
+// Применение проверенного состояния. Возвращает маску измененных полей
+// для уведомлений, в которой VLED_SET_RGB заменен на VLED_SET_COLOR.
+static inline __u32 vled_packed_apply(union vled_packed *s, const struct vled_state *st)
+{
+    __u32 rgb;
+    
+    if (st->mask & VLED_SET_LED_STATE)
+        s->led_state = st->led_state;
+    if (st->mask & VLED_SET_BRIGHTNESS)
+        s->brightness = st->brightness;
+    if ((st->mask & VLED_SET_COLOR) && vled_color_parse(st->color, &rgb) == 0)
+        vled_packed_set_rgb(s, rgb);
+    if (st->mask & VLED_SET_RGB)
+        vled_packed_set_rgb(s, st->rgb);
+    
+    return (st->mask & VLED_SET_ALL) | (st->mask & VLED_SET_RGB ? VLED_SET_COLOR : 0);
+}
+
+// Разбор текстовой команды ON, OFF, BRIGHTNESS n или COLOR c (кроме EFFECT)
+// в изменение *st для vled_packed_apply(). 0 или -EINVAL - команда не распознана.
+static inline int vled_command_parse(const char *cmd, struct vled_state *st)
+{
+    char color[VLED_COLOR_LEN];
+    int brightness;
+    
+    memset(st, 0, sizeof(*st));
+    if (strncmp(cmd, "ON", 2) == 0) {
+        st->mask = VLED_SET_LED_STATE;
+        st->led_state = 1;
+    } else if (strncmp(cmd, "OFF", 3) == 0) {
+        st->mask = VLED_SET_LED_STATE;
+        st->led_state = 0;
+    } else if (strncmp(cmd, "BRIGHTNESS ", 11) == 0) {
+        if (sscanf(cmd + 11, "%d", &brightness) != 1 || brightness < 0 || brightness > 255)
+            return -EINVAL;
+        st->mask = VLED_SET_BRIGHTNESS;
+        st->brightness = brightness;
+    } else if (strncmp(cmd, "COLOR ", 6) == 0) {
+        // Имя из палитры или #rrggbb
+        if (sscanf(cmd + 6, "%15s", color) != 1 || vled_color_parse(color, &st->rgb))
+            return -EINVAL;
+        st->mask = VLED_SET_RGB;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// Объединение изменений (команды одной записи, асинхронные изменения
+// libvled): поля из src заменяют поля dst, поэтому последовательность
+// изменений дает то же состояние, что и применение их по очереди. Цвет по
+// имени и цвет по RGB взаимно исключают друг друга.
+static inline void vled_state_merge(struct vled_state *dst, const struct vled_state *src)
+{
+    if (src->mask & VLED_SET_LED_STATE)
+        dst->led_state = src->led_state;
+    if (src->mask & VLED_SET_BRIGHTNESS)
+        dst->brightness = src->brightness;
+    if (src->mask & VLED_SET_COLOR) {
+        memcpy(dst->color, src->color, sizeof(dst->color));
+        dst->mask &= ~VLED_SET_RGB;
+    }
+    if (src->mask & VLED_SET_RGB) {
+        dst->rgb = src->rgb;
+        dst->mask &= ~VLED_SET_COLOR;
+    }
+    dst->mask |= src->mask;
+}
+
+// Поток команд, разделенных '\n'. Незавершенная команда остается в line
+// до следующей порции данных, поэтому команды можно разрезать между write().
+#define VLED_CMD_MAX 255
+
+struct vled_cmd_stream {
+    char line[VLED_CMD_MAX + 1];
+    __u32 len;                  // Накоплено байт незавершенной команды
+    __u32 overflow;             // Команда длиннее VLED_CMD_MAX, пропускается до '\n'
+};
+
+static inline int vled_cmd_stream_pending(const struct vled_cmd_stream *cs)
+{
+    return cs->len || cs->overflow;
+}
+
+// Завершение команды в line; '\r' перед '\n' отбрасывается
+static inline int vled_cmd_stream_end(struct vled_cmd_stream *cs)
+{
+    int retval = cs->overflow ? -EINVAL : 1;
+    
+    if (cs->len && cs->line[cs->len - 1] == '\r')
+        cs->len--;
+    cs->line[cs->len] = '\0';
+    cs->len = 0;
+    cs->overflow = 0;
+    return retval;
+}
+
+// Следующая команда из *data, *data и *len сдвигаются за прочитанное.
+// 1 - в line завершенная команда без '\n'; -EINVAL - команда слишком
+// длинная и пропущена; 0 - данные закончились, начало команды сохранено.
+static inline int vled_cmd_stream_next(struct vled_cmd_stream *cs, const char **data, size_t *len)
+{
+    const char *nl = memchr(*data, '\n', *len);
+    size_t n = nl ? (size_t)(nl - *data) : *len;
+    
+    if (!cs->overflow) {
+        if (cs->len + n > VLED_CMD_MAX) {
+            cs->overflow = 1;
+        } else {
+            memcpy(cs->line + cs->len, *data, n);
+            cs->len += n;
+        }
+    }
+    if (nl)
+        n++;
+    *data += n;
+    *len -= n;
+    return nl ? vled_cmd_stream_end(cs) : 0;
+}
+
+// Конец потока (закрытие дескриптора): незавершенная команда считается полной
+static inline int vled_cmd_stream_finish(struct vled_cmd_stream *cs)
+{
+    return vled_cmd_stream_pending(cs) ? vled_cmd_stream_end(cs) : 0;
+}
+
+// Шестнадцатеричное число с необязательным 0x и переводом строки в конце
+static inline int vled_parse_hex(const char *buf, __u32 *value)
+{
+    __u32 v = 0;
+    int digits = 0;
+    
+    if (buf[0] == '0' && (buf[1] | 0x20) == 'x')
+        buf += 2;
+    for (; *buf && *buf != '\n'; buf++, digits++) {
+        char c = *buf | 0x20;
+        if (digits == 8)
+            return -EINVAL;
+        if (*buf >= '0' && *buf <= '9')
+            v = v << 4 | (__u32)(*buf - '0');
+        else if (c >= 'a' && c <= 'f')
+            v = v << 4 | (__u32)(c - 'a' + 10);
+        else
+            return -EINVAL;
+    }
+    if (!digits || (*buf == '\n' && buf[1]))
+        return -EINVAL;
+    *value = v;
+    return 0;
+}
+
+static inline int vled_attr_show(union vled_packed s, enum vled_attr attr, char *buf, size_t size)
+{
+    char color[VLED_COLOR_LEN];
+    
+    switch (attr) {
+    case VLED_ATTR_LED_STATE:
+        return snprintf(buf, size, "%u\n", s.led_state);
+    case VLED_ATTR_BRIGHTNESS:
+        return snprintf(buf, size, "%u\n", s.brightness);
+    case VLED_ATTR_COLOR:
+        vled_color_format(s, color);
+        return snprintf(buf, size, "%s\n", color);
+    case VLED_ATTR_RGB:
+        // Цвет числом: чтение - rrggbb, запись - шестнадцатеричное значение до ffffff
+        return snprintf(buf, size, "%06x\n", s.rgb);
+    default:
+        return -EINVAL;
+    }
+}
+
+// Разбор записи атрибута в изменение *st для vled_packed_apply(); 0 или -EINVAL
+static inline int vled_attr_parse(enum vled_attr attr, const char *buf, struct vled_state *st)
+{
+    char color[VLED_COLOR_LEN];
+    int value;
+    
+    memset(st, 0, sizeof(*st));
+    switch (attr) {
+    case VLED_ATTR_LED_STATE:
+        if (sscanf(buf, "%d", &value) != 1 || (value != 0 && value != 1))
+            return -EINVAL;
+        st->mask = VLED_SET_LED_STATE;
+        st->led_state = value;
+        return 0;
+    case VLED_ATTR_BRIGHTNESS:
+        if (sscanf(buf, "%d", &value) != 1 || value < 0 || value > 255)
+            return -EINVAL;
+        st->mask = VLED_SET_BRIGHTNESS;
+        st->brightness = value;
+        return 0;
+    case VLED_ATTR_COLOR:
+        if (sscanf(buf, "%15s", color) != 1 || vled_color_parse(color, &st->rgb))
+            return -EINVAL;
+        st->mask = VLED_SET_RGB;
+        return 0;
+    case VLED_ATTR_RGB:
+        if (vled_parse_hex(buf, &st->rgb) || st->rgb > VLED_RGB_MAX)
+            return -EINVAL;
+        st->mask = VLED_SET_RGB;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+#endif /* _VLED_CORE_H */
@@ -0,0 +1,205 @@
+#ifndef _VLED_IOCTL_H
+#define _VLED_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// Версия бинарного интерфейса, увеличивается при каждом изменении
+#define VLED_ABI_VERSION 12
+
+#define VLED_IOC_MAGIC 'v'
+#define VLED_COLOR_LEN 16
+
+// Флаги полей для VLED_IOC_SET_STATE
+#define VLED_SET_LED_STATE   (1U << 0)
+#define VLED_SET_BRIGHTNESS  (1U << 1)
+#define VLED_SET_COLOR       (1U << 2)
+#define VLED_SET_ALL         (VLED_SET_LED_STATE | VLED_SET_BRIGHTNESS | VLED_SET_COLOR)
+#define VLED_SET_RGB         (1U << 3)  // Задать цвет полем rgb вместо имени color
+
+#define VLED_RGB_MAX 0xffffffU
+
+// Состояние светодиода в бинарном виде (фиксированный размер)
+struct vled_state {
+    __u32 mask;                 // Какие поля применять (только для SET)
+    __u32 led_state;            // 0 - выключен, 1 - включен
+    __u32 brightness;           // Яркость 0-255
+    char color[VLED_COLOR_LEN]; // Имя цвета из палитры или "#rrggbb", строка с '\0'
+    __u32 rgb;                  // Цвет 0x00RRGGBB (для SET - с флагом VLED_SET_RGB)
+};
+
+// Обновление одного светодиода в кадре
+struct vled_led_update {
+    __u32 index;                // N в /dev/vledN
+    struct vled_state state;    // state.mask задает применяемые поля
+};
+
+// Кадр: массив обновлений, применяемый одним вызовом ioctl
+#define VLED_FRAME_MAX 65536
+struct vled_frame {
+    __u32 count;                // Число элементов в updates
+    __u32 reserved;             // Должно быть 0
+    __u64 updates;              // Указатель на struct vled_led_update[count]
+};
+
+// Эффекты, выполняемые в ядре по таймеру
+#define VLED_EFFECT_NONE    0
+#define VLED_EFFECT_BLINK   1   // Переключение led_state: on_ms включен, off_ms выключен
+#define VLED_EFFECT_FADE    2   // Линейное изменение яркости from -> to за duration_ms
+#define VLED_EFFECT_BREATHE 3   // Плавное "дыхание" яркости min -> max -> min за period_ms
+#define VLED_EFFECT_PATTERN 4   // Последовательность ключевых кадров
+
+#define VLED_EFFECT_REPEAT  (1U << 0)  // pattern: повторять бесконечно
+#define VLED_EFFECT_SMOOTH  (1U << 1)  // pattern: интерполировать яркость между кадрами
+
+#define VLED_EFFECT_MAX_KEYFRAMES 16
+#define VLED_EFFECT_DEFAULT_STEP_MS 20
+
+struct vled_keyframe {
+    __u32 duration_ms;
+    __u32 led_state;
+    __u32 brightness;
+};
+
+struct vled_effect {
+    __u32 type;                 // VLED_EFFECT_*
+    __u32 flags;                // VLED_EFFECT_REPEAT | VLED_EFFECT_SMOOTH
+    __u32 step_ms;              // Шаг изменения яркости, 0 - по умолчанию
+    union {
+        struct {
+            __u32 on_ms;
+            __u32 off_ms;
+        } blink;
+        struct {
+            __u32 from;
+            __u32 to;
+            __u32 duration_ms;
+        } fade;
+        struct {
+            __u32 min;
+            __u32 max;
+            __u32 period_ms;
+        } breathe;
+        struct {
+            __u32 count;
+            struct vled_keyframe keyframes[VLED_EFFECT_MAX_KEYFRAMES];
+        } pattern;
+    };
+};
+
+// Режимы чтения /dev/vled для VLED_IOC_SET_READ_MODE
+#define VLED_READ_SNAPSHOT 0    // read() сразу возвращает текущее состояние
+#define VLED_READ_WAIT     1    // read() блокируется до следующего изменения
+
+// Форматы read() для VLED_IOC_SET_READ_FORMAT. Запись формируется из одного
+// снимка при чтении с позиции 0 (в режиме ожидания - при новом изменении)
+// и дочитывается частями из того же снимка, следующие байты - конец файла.
+#define VLED_FORMAT_TEXT   0    // "LED State: ON\nBrightness: ...\nColor: ...\n"
+#define VLED_FORMAT_KV     1    // "led_state=1\nbrightness=...\ncolor=...\nrgb=...\nseq=...\n"
+#define VLED_FORMAT_JSON   2    // {"led_state":1,"brightness":...,"seq":...}\n
+#define VLED_FORMAT_BINARY 3    // struct vled_state_record
+
+// Запись формата VLED_FORMAT_BINARY
+struct vled_state_record {
+    __u32 seq;                  // Версия состояния, как в struct vled_state_update
+    __u32 reserved;
+    struct vled_state state;    // mask = VLED_SET_ALL
+};
+
+// Транзакционное изменение для VLED_IOC_UPDATE_STATE: поля state.mask
+// применяются одной критической секцией, с VLED_UPDATE_IF_SEQ - только если
+// версия состояния равна expected_seq. Иначе ioctl возвращает EAGAIN, а
+// state и seq содержат текущее состояние и его версию. Пустая маска без
+// условия - чтение состояния вместе с версией.
+#define VLED_UPDATE_IF_SEQ (1U << 0)
+
+struct vled_state_update {
+    struct vled_state state;    // Вход: изменение; выход: состояние после него
+    __u32 flags;                // VLED_UPDATE_*
+    __u32 expected_seq;         // Ожидаемая версия для VLED_UPDATE_IF_SEQ
+    __u32 seq;                  // Выход: версия после изменения, всегда четная
+    __u32 reserved;             // Должно быть 0
+};
+
+// Итог последнего write() в /dev/vledN для VLED_IOC_GET_WRITE_STATUS.
+// Запись может содержать много команд, разделенных '\n'; команды нумеруются
+// с 1, пустые строки не считаются. Хвост записи без '\n' не выполняется, а
+// ждет продолжения в следующей записи; выполняется он по fsync() или при
+// закрытии дескриптора. Итог записи без ошибок сохраняется, только если
+// VLED_IOC_GET_WRITE_STATUS уже вызывался на этом дескрипторе.
+// До VLED_ABI_VERSION 12 запись без '\n' выполнялась сразу, если от прошлой
+// записи не оставалось хвоста.
+struct vled_write_status {
+    __u32 commands;             // Завершенных команд в записи
+    __u32 applied;              // Из них применено
+    __u32 rejected;             // Из них отклонено
+    __u32 first_error;          // Номер первой отклоненной команды, 0 - ошибок нет
+    __s32 error;                // Код ошибки первой отклоненной команды (-EINVAL...)
+    __u32 pending;              // Байт незавершенной команды, ждущих следующей записи
+};
+
+// Индексы известных цветов
+enum vled_color_index {
+    VLED_COLOR_RED,
+    VLED_COLOR_GREEN,
+    VLED_COLOR_BLUE,
+    VLED_COLOR_YELLOW,
+    VLED_COLOR_WHITE,
+    VLED_COLOR_CYAN,
+    VLED_COLOR_MAGENTA,
+    VLED_COLOR_COUNT,
+    VLED_COLOR_CUSTOM = 255,    // Цвет вне палитры, задан как #rrggbb
+};
+
+// Страница состояния, доступная через mmap() на /dev/vled только для чтения.
+// seq нечетный во время обновления; читатель повторяет чтение, пока seq
+// не совпадет до и после копирования полей.
+struct vled_shared_page {
+    __u32 seq;
+    __u32 abi_version;
+    __u32 led_state;
+    __u32 brightness;
+    __u32 color_index;          // enum vled_color_index
+    __u32 rgb;                  // 0x00RRGGBB
+    char color[VLED_COLOR_LEN];
+};
+
+// Источник изменения состояния в журнале событий
+#define VLED_SRC_CHARDEV 0      // Текстовая команда через write()
+#define VLED_SRC_SYSFS   1      // Запись атрибута sysfs
+#define VLED_SRC_IOCTL   2      // Бинарный интерфейс ioctl
+#define VLED_SRC_EFFECT  3      // Шаг движка эффектов
+#define VLED_SRC_LEDCLASS 4     // Подсистема LED ядра (триггеры, /sys/class/leds)
+
+// Запись журнала переходов, читается из /dev/vled_events целыми записями.
+// seq растет на 1 для каждого события, разрыв означает потерянные записи.
+// Для цвета old_value/new_value - значения 0x00RRGGBB.
+struct vled_event {
+    __u64 timestamp_ns;         // CLOCK_MONOTONIC
+    __u64 seq;
+    __u32 pid;
+    __u16 source;               // VLED_SRC_*
+    __u16 field;                // Один из флагов VLED_SET_*
+    __u32 old_value;
+    __u32 new_value;
+};
+
+#define VLED_IOC_GET_VERSION _IOR(VLED_IOC_MAGIC, 0, __u32)
+#define VLED_IOC_GET_STATE   _IOR(VLED_IOC_MAGIC, 1, struct vled_state)
+#define VLED_IOC_SET_STATE   _IOW(VLED_IOC_MAGIC, 2, struct vled_state)
+#define VLED_IOC_SET_READ_MODE _IOW(VLED_IOC_MAGIC, 3, __u32)
+// Кадры можно отправлять через любой /dev/vledN, индексы глобальные.
+// SET_FRAME проверяет все записи до применения; GET_FRAME заполняет state
+// для перечисленных индексов согласованно относительно других кадров.
+#define VLED_IOC_SET_FRAME   _IOW(VLED_IOC_MAGIC, 4, struct vled_frame)
+#define VLED_IOC_GET_FRAME   _IOW(VLED_IOC_MAGIC, 5, struct vled_frame)
+#define VLED_IOC_SET_EFFECT  _IOW(VLED_IOC_MAGIC, 6, struct vled_effect)
+#define VLED_IOC_GET_EFFECT  _IOR(VLED_IOC_MAGIC, 7, struct vled_effect)
+#define VLED_IOC_GET_WRITE_STATUS _IOR(VLED_IOC_MAGIC, 8, struct vled_write_status)
+#define VLED_IOC_UPDATE_STATE _IOWR(VLED_IOC_MAGIC, 9, struct vled_state_update)
+#define VLED_IOC_SET_READ_FORMAT _IOW(VLED_IOC_MAGIC, 10, __u32)
+
+// ioctl для /dev/vled_events: число записей, перезаписанных до прочтения
+#define VLED_IOC_EVENTS_LOST _IOR(VLED_IOC_MAGIC, 16, __u64)
+
+#endif /* _VLED_IOCTL_H */
@@ -0,0 +1,756 @@
+#define FUSE_USE_VERSION 31
+
+#include <cuse_lowlevel.h>
+#include <fuse.h>
+#include <fuse_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "vled_core.h"
+
+// Симулятор драйвера в пространстве пользователя: /dev/vledN через CUSE и,
+// по желанию, каталог с файлами атрибутов через FUSE. Разбор команд и
+// переходы состояния - те же функции vled_core.h, что и в модуле, поэтому
+// тесты и замеры можно запускать без загрузки модуля.
+// Не поддерживаются: mmap (libvled читает состояние через ioctl), эффекты,
+// журнал событий и кадры с чужими индексами - симулятор обслуживает один
+// светодиод.
+
+#define SIM_ATTR_SIZE 4096
+
+// Открытый дескриптор устройства
+struct sim_session {
+    struct sim_session *next;
+    unsigned int seen_seq;      // Версия состояния, последняя отданная читателю
+    __u32 read_mode;            // VLED_READ_SNAPSHOT или VLED_READ_WAIT
+    __u32 read_format;          // VLED_FORMAT_*
+    size_t read_len;            // Длина записи в read_buf
+    size_t read_pos;            // Прочитано в режиме VLED_READ_WAIT
+    char read_buf[VLED_READ_MAX];
+    int nonblock;
+    struct fuse_pollhandle *ph; // Ожидающий poll()
+    fuse_req_t wait_req;        // Ожидающий read() в режиме VLED_READ_WAIT
+    size_t wait_size;
+    struct vled_cmd_stream stream;      // Незавершенная команда между записями
+    struct vled_write_status write_status; // Итог последнего write()
+};
+
+// Состояние устройства; lock рекурсивный, так как libfuse может вызвать
+// обработчик прерывания запроса прямо из fuse_req_interrupt_func()
+static struct {
+    pthread_mutex_t lock;
+    union vled_packed state;
+    unsigned int seq;           // Растет на 2 при каждом изменении, как seqcount модуля
+    unsigned int index;         // N в /dev/vledN
+    struct sim_session *sessions;
+    const char *attrs_dir;
+    struct fuse *attrs;
+    pthread_t attrs_thread;
+} sim;
+
+static struct sim_session *sim_session(struct fuse_file_info *fi)
+{
+    return (struct sim_session *)(uintptr_t)fi->fh;
+}
+
+// Новая запись для read() из текущего состояния, вызывается под lock
+static void sim_read_fill(struct sim_session *session)
+{
+    int n = vled_state_render(sim.state, sim.seq, session->read_format,
+                              session->read_buf, sizeof(session->read_buf));
+    
+    session->read_len = n < 0 ? 0 : n >= (int)sizeof(session->read_buf) ?
+                        sizeof(session->read_buf) - 1 : (size_t)n;
+    session->read_pos = 0;
+    session->seen_seq = sim.seq;
+}
+
+// Ответ частью записи с позиции pos, вызывается под lock
+static size_t sim_read_reply(fuse_req_t req, struct sim_session *session, size_t size, size_t pos)
+{
+    if (pos >= session->read_len)
+        size = 0;
+    else if (size > session->read_len - pos)
+        size = session->read_len - pos;
+    fuse_reply_buf(req, session->read_buf + pos, size);
+    return size;
+}
+
+// Публикация изменения, вызывается под lock: пробуждение poll() и
+// ожидающих чтений
+static void sim_notify(__u32 changed)
+{
+    struct sim_session *session;
+    
+    if (!changed)
+        return;
+    sim.seq += 2;
+    for (session = sim.sessions; session; session = session->next) {
+        if (session->ph) {
+            fuse_lowlevel_notify_poll(session->ph);
+            fuse_pollhandle_destroy(session->ph);
+            session->ph = NULL;
+        }
+        if (session->wait_req) {
+            fuse_req_t req = session->wait_req;
+            session->wait_req = NULL;
+            sim_read_fill(session);
+            session->read_pos = sim_read_reply(req, session, session->wait_size, 0);
+        }
+    }
+}
+
+static void sim_update(const struct vled_state *st)
+{
+    pthread_mutex_lock(&sim.lock);
+    sim_notify(vled_packed_apply(&sim.state, st));
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static void sim_open(fuse_req_t req, struct fuse_file_info *fi)
+{
+    struct sim_session *session = calloc(1, sizeof(*session));
+    
+    if (!session) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    session->read_mode = VLED_READ_SNAPSHOT;
+    session->nonblock = !!(fi->flags & O_NONBLOCK);
+    
+    pthread_mutex_lock(&sim.lock);
+    session->seen_seq = sim.seq;
+    session->next = sim.sessions;
+    sim.sessions = session;
+    pthread_mutex_unlock(&sim.lock);
+    
+    fi->fh = (uintptr_t)session;
+    fi->direct_io = 1;
+    fuse_reply_open(req, fi);
+}
+
+// Прерывание ожидающего read() сигналом
+static void sim_read_interrupt(fuse_req_t req, void *data)
+{
+    struct sim_session *session = data;
+    
+    pthread_mutex_lock(&sim.lock);
+    if (session->wait_req == req) {
+        session->wait_req = NULL;
+        fuse_reply_err(req, EINTR);
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+
+// Как в модуле: снимок читается с позиции 0 и дочитывается из того же
+// снимка; в режиме ожидания остаток записи отдается без ожидания
+static void sim_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    struct sim_session *session = sim_session(fi);
+    
+    pthread_mutex_lock(&sim.lock);
+    if (session->read_mode == VLED_READ_WAIT) {
+        if (session->read_pos < session->read_len) {
+            session->read_pos += sim_read_reply(req, session, size, session->read_pos);
+        } else if (sim.seq != session->seen_seq) {
+            sim_read_fill(session);
+            session->read_pos = sim_read_reply(req, session, size, 0);
+        } else if (session->nonblock || session->wait_req) {
+            fuse_reply_err(req, session->nonblock ? EAGAIN : EBUSY);
+        } else {
+            // Ответ откладывается до следующего изменения
+            session->wait_req = req;
+            session->wait_size = size;
+            fuse_req_interrupt_func(req, sim_read_interrupt, session);
+        }
+    } else {
+        if (off == 0)
+            sim_read_fill(session);
+        sim_read_reply(req, session, size, off);
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+
+static void sim_write_reject(struct vled_write_status *status, int error)
+{
+    status->rejected++;
+    if (!status->first_error) {
+        status->first_error = status->commands;
+        status->error = error;
+    }
+}
+
+// Одна завершенная команда, как vled_write_command() в модуле: изменения
+// объединяются в *st и применяются один раз на запись
+static void sim_write_command(struct vled_state *st, struct vled_write_status *status,
+                              const char *cmd, int result)
+{
+    struct vled_state cmd_st;
+    
+    if (result > 0 && cmd[0] == '\0')
+        return;
+    status->commands++;
+    if (result < 0) {
+        sim_write_reject(status, result);
+    } else if (strncmp(cmd, "EFFECT ", 7) == 0) {
+        // Движка эффектов в симуляторе нет
+        sim_write_reject(status, -EOPNOTSUPP);
+    } else if (vled_command_parse(cmd, &cmd_st)) {
+        sim_write_reject(status, -EINVAL);
+    } else {
+        vled_state_merge(st, &cmd_st);
+        status->applied++;
+    }
+}
+
+static void sim_write(fuse_req_t req, const char *buf, size_t size, off_t off,
+                      struct fuse_file_info *fi)
+{
+    struct sim_session *session = sim_session(fi);
+    struct vled_write_status status = {};
+    struct vled_state st = {};
+    const char *p = buf;
+    size_t left = size;
+    int result;
+    
+    // Вся запись - одна критическая секция, как в модуле
+    // Хвост без '\n' ждет следующей записи, fsync() или закрытия
+    pthread_mutex_lock(&sim.lock);
+    while ((result = vled_cmd_stream_next(&session->stream, &p, &left)) != 0)
+        sim_write_command(&st, &status, session->stream.line, result);
+    sim_update(&st);
+    
+    status.pending = session->stream.len;
+    session->write_status = status;
+    pthread_mutex_unlock(&sim.lock);
+    
+    fuse_reply_write(req, size);
+}
+
+// Выполнение хвоста без '\n', вызывается под sim.lock; ошибка команды или 0
+static int sim_write_flush(struct sim_session *session)
+{
+    struct vled_write_status status = {};
+    struct vled_state st = {};
+    
+    if (!vled_cmd_stream_pending(&session->stream))
+        return 0;
+    sim_write_command(&st, &status, session->stream.line,
+                      vled_cmd_stream_finish(&session->stream));
+    sim_update(&st);
+    session->write_status = status;
+    return status.error;
+}
+
+static void sim_fsync(fuse_req_t req, int datasync, struct fuse_file_info *fi)
+{
+    int retval;
+    
+    pthread_mutex_lock(&sim.lock);
+    retval = sim_write_flush(sim_session(fi));
+    pthread_mutex_unlock(&sim.lock);
+    fuse_reply_err(req, -retval);
+}
+
+static void sim_release(fuse_req_t req, struct fuse_file_info *fi)
+{
+    struct sim_session *session = sim_session(fi);
+    struct sim_session **p;
+    
+    pthread_mutex_lock(&sim.lock);
+    // Хвост без завершающего '\n' выполняется при закрытии
+    sim_write_flush(session);
+    for (p = &sim.sessions; *p; p = &(*p)->next) {
+        if (*p == session) {
+            *p = session->next;
+            break;
+        }
+    }
+    if (session->ph)
+        fuse_pollhandle_destroy(session->ph);
+    pthread_mutex_unlock(&sim.lock);
+    
+    free(session);
+    fuse_reply_err(req, 0);
+}
+
+static void sim_poll(fuse_req_t req, struct fuse_file_info *fi, struct fuse_pollhandle *ph)
+{
+    struct sim_session *session = sim_session(fi);
+    unsigned revents = POLLOUT | POLLWRNORM;    // Запись не блокируется
+    
+    pthread_mutex_lock(&sim.lock);
+    if (ph) {
+        if (session->ph)
+            fuse_pollhandle_destroy(session->ph);
+        session->ph = ph;
+    }
+    if (sim.seq != session->seen_seq)
+        revents |= POLLIN | POLLRDNORM;
+    pthread_mutex_unlock(&sim.lock);
+    
+    fuse_reply_poll(req, revents);
+}
+
+// Кадры: структура vled_frame содержит указатель на массив обновлений,
+// поэтому данные запрашиваются у ядра в два шага через повтор ioctl
+static void sim_ioctl_frame(fuse_req_t req, unsigned int cmd, void *arg,
+                            const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+    const struct vled_frame *frame = in_buf;
+    struct vled_led_update *updates;
+    struct iovec in_iov[2], out_iov;
+    size_t updates_size;
+    
+    in_iov[0].iov_base = arg;
+    in_iov[0].iov_len = sizeof(*frame);
+    if (in_bufsz < sizeof(*frame)) {
+        fuse_reply_ioctl_retry(req, in_iov, 1, NULL, 0);
+        return;
+    }
+    if (frame->reserved || frame->count == 0 || frame->count > VLED_FRAME_MAX) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    
+    updates_size = (size_t)frame->count * sizeof(*updates);
+    in_iov[1].iov_base = (void *)(uintptr_t)frame->updates;
+    in_iov[1].iov_len = updates_size;
+    out_iov = in_iov[1];
+    if (in_bufsz < sizeof(*frame) + updates_size ||
+        (cmd == VLED_IOC_GET_FRAME && out_bufsz < updates_size)) {
+        if (cmd == VLED_IOC_GET_FRAME)
+            fuse_reply_ioctl_retry(req, in_iov, 2, &out_iov, 1);
+        else
+            fuse_reply_ioctl_retry(req, in_iov, 2, NULL, 0);
+        return;
+    }
+    
+    updates = malloc(updates_size);
+    if (!updates) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    memcpy(updates, (const char *)in_buf + sizeof(*frame), updates_size);
+    
+    for (__u32 i = 0; i < frame->count; i++) {
+        if (updates[i].index != sim.index ||
+            (cmd == VLED_IOC_SET_FRAME && vled_state_validate(&updates[i].state))) {
+            free(updates);
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+    }
+    
+    pthread_mutex_lock(&sim.lock);
+    if (cmd == VLED_IOC_SET_FRAME) {
+        __u32 changed = 0;
+        for (__u32 i = 0; i < frame->count; i++)
+            changed |= vled_packed_apply(&sim.state, &updates[i].state);
+        sim_notify(changed);
+    } else {
+        for (__u32 i = 0; i < frame->count; i++)
+            vled_packed_to_state(sim.state, &updates[i].state);
+    }
+    pthread_mutex_unlock(&sim.lock);
+    
+    if (cmd == VLED_IOC_GET_FRAME)
+        fuse_reply_ioctl(req, 0, updates, updates_size);
+    else
+        fuse_reply_ioctl(req, 0, NULL, 0);
+    free(updates);
+}
+
+// CUSE передает ioctl без разбора: при первом вызове буферы пусты, и размер
+// данных запрашивается повтором с указанием адреса и длины
+static void sim_ioctl(fuse_req_t req, int cmd, void *arg, struct fuse_file_info *fi,
+                      unsigned flags, const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+    struct sim_session *session = sim_session(fi);
+    struct vled_effect eff;
+    struct vled_state st;
+    struct iovec iov = { arg, 0 };
+    __u32 value;
+    
+    if (flags & FUSE_IOCTL_COMPAT) {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+    
+    switch ((unsigned int)cmd) {
+    case VLED_IOC_GET_VERSION:
+        if (!out_bufsz) {
+            iov.iov_len = sizeof(value);
+            fuse_reply_ioctl_retry(req, NULL, 0, &iov, 1);
+            return;
+        }
+        value = VLED_ABI_VERSION;
+        fuse_reply_ioctl(req, 0, &value, sizeof(value));
+        return;
+    case VLED_IOC_GET_STATE:
+        if (!out_bufsz) {
+            iov.iov_len = sizeof(st);
+            fuse_reply_ioctl_retry(req, NULL, 0, &iov, 1);
+            return;
+        }
+        pthread_mutex_lock(&sim.lock);
+        vled_packed_to_state(sim.state, &st);
+        pthread_mutex_unlock(&sim.lock);
+        fuse_reply_ioctl(req, 0, &st, sizeof(st));
+        return;
+    case VLED_IOC_SET_STATE:
+        if (!in_bufsz) {
+            iov.iov_len = sizeof(st);
+            fuse_reply_ioctl_retry(req, &iov, 1, NULL, 0);
+            return;
+        }
+        memcpy(&st, in_buf, sizeof(st));
+        if (vled_state_validate(&st)) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        sim_update(&st);
+        fuse_reply_ioctl(req, 0, NULL, 0);
+        return;
+    case VLED_IOC_UPDATE_STATE: {
+        struct vled_state_update upd;
+        int result = 0;
+        
+        if (!in_bufsz || !out_bufsz) {
+            iov.iov_len = sizeof(upd);
+            fuse_reply_ioctl_retry(req, &iov, 1, &iov, 1);
+            return;
+        }
+        memcpy(&upd, in_buf, sizeof(upd));
+        if ((upd.flags & ~VLED_UPDATE_IF_SEQ) || upd.reserved || vled_state_validate(&upd.state)) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        // Отрицательный результат ioctl CUSE передает вместе с данными,
+        // поэтому при конфликте клиент получает текущее состояние, как от модуля
+        pthread_mutex_lock(&sim.lock);
+        if ((upd.flags & VLED_UPDATE_IF_SEQ) && sim.seq != upd.expected_seq)
+            result = -EAGAIN;
+        else
+            sim_notify(vled_packed_apply(&sim.state, &upd.state));
+        upd.seq = sim.seq;
+        vled_packed_to_state(sim.state, &upd.state);
+        pthread_mutex_unlock(&sim.lock);
+        fuse_reply_ioctl(req, result, &upd, sizeof(upd));
+        return;
+    }
+    case VLED_IOC_GET_WRITE_STATUS: {
+        struct vled_write_status status;
+        
+        if (!out_bufsz) {
+            iov.iov_len = sizeof(status);
+            fuse_reply_ioctl_retry(req, NULL, 0, &iov, 1);
+            return;
+        }
+        pthread_mutex_lock(&sim.lock);
+        status = session->write_status;
+        pthread_mutex_unlock(&sim.lock);
+        fuse_reply_ioctl(req, 0, &status, sizeof(status));
+        return;
+    }
+    case VLED_IOC_SET_READ_MODE:
+        if (!in_bufsz) {
+            iov.iov_len = sizeof(value);
+            fuse_reply_ioctl_retry(req, &iov, 1, NULL, 0);
+            return;
+        }
+        memcpy(&value, in_buf, sizeof(value));
+        if (value != VLED_READ_SNAPSHOT && value != VLED_READ_WAIT) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        pthread_mutex_lock(&sim.lock);
+        session->read_mode = value;
+        pthread_mutex_unlock(&sim.lock);
+        fuse_reply_ioctl(req, 0, NULL, 0);
+        return;
+    case VLED_IOC_SET_READ_FORMAT:
+        if (!in_bufsz) {
+            iov.iov_len = sizeof(value);
+            fuse_reply_ioctl_retry(req, &iov, 1, NULL, 0);
+            return;
+        }
+        memcpy(&value, in_buf, sizeof(value));
+        if (value > VLED_FORMAT_BINARY) {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+        // Недочитанная запись в старом формате отбрасывается
+        pthread_mutex_lock(&sim.lock);
+        session->read_format = value;
+        session->read_len = 0;
+        session->read_pos = 0;
+        pthread_mutex_unlock(&sim.lock);
+        fuse_reply_ioctl(req, 0, NULL, 0);
+        return;
+    case VLED_IOC_SET_FRAME:
+    case VLED_IOC_GET_FRAME:
+        sim_ioctl_frame(req, cmd, arg, in_buf, in_bufsz, out_bufsz);
+        return;
+    case VLED_IOC_GET_EFFECT:
+        if (!out_bufsz) {
+            iov.iov_len = sizeof(eff);
+            fuse_reply_ioctl_retry(req, NULL, 0, &iov, 1);
+            return;
+        }
+        memset(&eff, 0, sizeof(eff));
+        eff.type = VLED_EFFECT_NONE;
+        fuse_reply_ioctl(req, 0, &eff, sizeof(eff));
+        return;
+    case VLED_IOC_SET_EFFECT:
+        fuse_reply_err(req, EOPNOTSUPP);
+        return;
+    default:
+        fuse_reply_err(req, ENOTTY);
+        return;
+    }
+}
+
+// Файлы атрибутов: те же имена (vled_attr_names) и форматы, что и в
+// /sys/class/vled/vledN
+
+static int sim_attr_find(const char *path)
+{
+    if (path[0] != '/')
+        return -1;
+    for (int attr = 0; attr < VLED_ATTR_ALL; attr++)
+        if (strcmp(path + 1, vled_attr_names[attr]) == 0)
+            return attr;
+    return -1;
+}
+
+static int sim_attr_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi)
+{
+    int attr;
+    
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+        return 0;
+    }
+    attr = sim_attr_find(path);
+    if (attr < 0)
+        return -ENOENT;
+    stbuf->st_mode = S_IFREG | (attr < VLED_ATTR_COUNT ? 0664 : 0444);
+    stbuf->st_nlink = 1;
+    stbuf->st_size = attr == VLED_ATTR_STATE_RAW ? sizeof(struct vled_state_record) : SIM_ATTR_SIZE;
+    return 0;
+}
+
+static int sim_attr_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t off,
+                            struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+    if (strcmp(path, "/") != 0)
+        return -ENOENT;
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    for (int attr = 0; attr < VLED_ATTR_ALL; attr++)
+        filler(buf, vled_attr_names[attr], NULL, 0, 0);
+    return 0;
+}
+
+static int sim_attr_open(const char *path, struct fuse_file_info *fi)
+{
+    if (sim_attr_find(path) < 0)
+        return -ENOENT;
+    // Содержимое формируется при каждом чтении, как в sysfs
+    fi->direct_io = 1;
+    return 0;
+}
+
+static int sim_attr_read(const char *path, char *buf, size_t size, off_t off,
+                         struct fuse_file_info *fi)
+{
+    char value[VLED_READ_MAX];
+    int attr = sim_attr_find(path);
+    int len;
+    
+    if (attr < 0)
+        return -ENOENT;
+    pthread_mutex_lock(&sim.lock);
+    if (attr == VLED_ATTR_STATE)
+        len = vled_state_render(sim.state, sim.seq, VLED_FORMAT_KV, value, sizeof(value));
+    else if (attr == VLED_ATTR_STATE_RAW)
+        len = vled_state_render(sim.state, sim.seq, VLED_FORMAT_BINARY, value, sizeof(value));
+    else
+        len = vled_attr_show(sim.state, attr, value, sizeof(value));
+    pthread_mutex_unlock(&sim.lock);
+    
+    if (off >= len)
+        return 0;
+    if (size > (size_t)(len - off))
+        size = len - off;
+    memcpy(buf, value + off, size);
+    return size;
+}
+
+static int sim_attr_write(const char *path, const char *buf, size_t size, off_t off,
+                          struct fuse_file_info *fi)
+{
+    struct vled_state st;
+    char value[SIM_ATTR_SIZE];
+    int attr = sim_attr_find(path);
+    
+    if (attr < 0)
+        return -ENOENT;
+    if (attr >= VLED_ATTR_COUNT)
+        return -EACCES;
+    if (off != 0 || size >= sizeof(value))
+        return -EINVAL;
+    memcpy(value, buf, size);
+    value[size] = '\0';
+    
+    // Как в модуле: неверное значение rgb - ошибка, остальные игнорируются
+    if (vled_attr_parse(attr, value, &st))
+        return attr == VLED_ATTR_RGB ? -EINVAL : (int)size;
+    sim_update(&st);
+    return size;
+}
+
+static int sim_attr_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+    return sim_attr_find(path) < 0 ? -ENOENT : 0;
+}
+
+static const struct fuse_operations sim_attr_ops = {
+    .getattr  = sim_attr_getattr,
+    .readdir  = sim_attr_readdir,
+    .open     = sim_attr_open,
+    .read     = sim_attr_read,
+    .write    = sim_attr_write,
+    .truncate = sim_attr_truncate,
+};
+
+static void *sim_attrs_run(void *arg)
+{
+    fuse_loop(sim.attrs);
+    return NULL;
+}
+
+// Вызывается после создания /dev/vledN (и ухода в фон без -f)
+static void sim_init_done(void *userdata)
+{
+    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+    
+    fprintf(stderr, "vled_sim: /dev/vled%u ready\n", sim.index);
+    if (!sim.attrs_dir)
+        return;
+    
+    // Права проверяет ядро по режиму файлов, как для sysfs
+    fuse_opt_add_arg(&args, "vled_sim");
+    fuse_opt_add_arg(&args, "-oallow_other,default_permissions");
+    sim.attrs = fuse_new(&args, &sim_attr_ops, sizeof(sim_attr_ops), NULL);
+    fuse_opt_free_args(&args);
+    if (!sim.attrs || fuse_mount(sim.attrs, sim.attrs_dir) != 0 ||
+        pthread_create(&sim.attrs_thread, NULL, sim_attrs_run, NULL) != 0) {
+        fprintf(stderr, "vled_sim: cannot mount attributes at %s\n", sim.attrs_dir);
+        if (sim.attrs)
+            fuse_destroy(sim.attrs);
+        sim.attrs = NULL;
+        return;
+    }
+    fprintf(stderr, "vled_sim: attributes in %s\n", sim.attrs_dir);
+}
+
+static const struct cuse_lowlevel_ops sim_ops = {
+    .init_done = sim_init_done,
+    .open      = sim_open,
+    .fsync     = sim_fsync,
+    .release   = sim_release,
+    .read      = sim_read,
+    .write     = sim_write,
+    .ioctl     = sim_ioctl,
+    .poll      = sim_poll,
+};
+
+static void sim_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-i index] [--attrs dir] [-f] [-s] [-d]\n"
+            "  -i index     create /dev/vled<index>, default 0\n"
+            "  --attrs dir  mount led_state, brightness, color, rgb files in dir\n"
+            "  -f           stay in foreground, -s single thread, -d debug\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct cuse_info ci;
+    pthread_mutexattr_t attr;
+    char dev_name[32];
+    char attrs_dir[PATH_MAX];
+    const char *dev_info_argv[] = { dev_name };
+    char **cuse_argv;
+    int cuse_argc = 0;
+    int retval;
+    
+    // Свои параметры разбираются здесь, остальные передаются libfuse
+    cuse_argv = calloc(argc + 1, sizeof(*cuse_argv));
+    if (!cuse_argv)
+        return 1;
+    cuse_argv[cuse_argc++] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            sim.index = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--attrs") == 0 && i + 1 < argc) {
+            sim.attrs_dir = argv[++i];
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            sim_usage(argv[0]);
+            free(cuse_argv);
+            return 0;
+        } else {
+            cuse_argv[cuse_argc++] = argv[i];
+        }
+    }
+    
+    // Без -f демон переходит в корневой каталог, поэтому путь нужен полный
+    if (sim.attrs_dir) {
+        mkdir(sim.attrs_dir, 0755);
+        if (!realpath(sim.attrs_dir, attrs_dir)) {
+            fprintf(stderr, "vled_sim: %s: %s\n", sim.attrs_dir, strerror(errno));
+            free(cuse_argv);
+            return 1;
+        }
+        sim.attrs_dir = attrs_dir;
+    }
+    
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sim.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    
+    sim.state = vled_initial_state();
+    
+    snprintf(dev_name, sizeof(dev_name), "DEVNAME=vled%u", sim.index);
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = dev_info_argv;
+    ci.flags = CUSE_UNRESTRICTED_IOCTL;
+    
+    retval = cuse_lowlevel_main(cuse_argc, cuse_argv, &ci, &sim_ops, NULL);
+    
+    if (sim.attrs) {
+        fuse_exit(sim.attrs);
+        fuse_unmount(sim.attrs);
+        pthread_join(sim.attrs_thread, NULL);
+        fuse_destroy(sim.attrs);
+    }
+    free(cuse_argv);
+    return retval;
+}
@@ -0,0 +1,113 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM vled
+
+#if !defined(_VLED_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _VLED_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/string.h>
+
+#include "vled_ioctl.h"
+
+// Точки трассировки драйвера: /sys/kernel/tracing/events/vled/.
+// Выключенная точка стоит один пропущенный переход, поэтому они
+// вызываются на каждой команде вместо printk.
+
+#define VLED_TRACE_CMD_LEN 32
+
+#define vled_trace_source(src)                      \
+    __print_symbolic(src,                           \
+        { VLED_SRC_CHARDEV,  "chardev" },           \
+        { VLED_SRC_SYSFS,    "sysfs" },             \
+        { VLED_SRC_IOCTL,    "ioctl" },             \
+        { VLED_SRC_EFFECT,   "effect" },            \
+        { VLED_SRC_LEDCLASS, "ledclass" })
+
+// Команда получена, до разбора; текст обрезается до первого перевода строки
+TRACE_EVENT(vled_command,
+    TP_PROTO(unsigned int index, u16 source, const char *cmd),
+    TP_ARGS(index, source, cmd),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(u16, source)
+        __array(char, cmd, VLED_TRACE_CMD_LEN)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->source = source;
+        strscpy(__entry->cmd, cmd, VLED_TRACE_CMD_LEN);
+        __entry->cmd[strcspn(__entry->cmd, "\n")] = '\0';
+    ),
+
+    TP_printk("vled%u src=%s cmd=\"%s\"",
+              __entry->index, vled_trace_source(__entry->source), __entry->cmd)
+);
+
+// Состояние изменено и опубликовано, changed - маска VLED_SET_*
+TRACE_EVENT(vled_state_applied,
+    TP_PROTO(unsigned int index, u16 source, u32 changed,
+             u32 led_state, u32 brightness, u32 rgb),
+    TP_ARGS(index, source, changed, led_state, brightness, rgb),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(u16, source)
+        __field(u32, changed)
+        __field(u32, led_state)
+        __field(u32, brightness)
+        __field(u32, rgb)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->source = source;
+        __entry->changed = changed;
+        __entry->led_state = led_state;
+        __entry->brightness = brightness;
+        __entry->rgb = rgb;
+    ),
+
+    TP_printk("vled%u src=%s changed=%s state=%u brightness=%u rgb=#%06x",
+              __entry->index, vled_trace_source(__entry->source),
+              __print_flags(__entry->changed, "|",
+                            { VLED_SET_LED_STATE,  "led_state" },
+                            { VLED_SET_BRIGHTNESS, "brightness" },
+                            { VLED_SET_COLOR,      "color" }),
+              __entry->led_state, __entry->brightness, __entry->rgb)
+);
+
+// Команда отклонена: не распознана или значение вне диапазона
+TRACE_EVENT(vled_command_rejected,
+    TP_PROTO(unsigned int index, u16 source, const char *cmd, int error),
+    TP_ARGS(index, source, cmd, error),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(u16, source)
+        __field(int, error)
+        __array(char, cmd, VLED_TRACE_CMD_LEN)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->source = source;
+        __entry->error = error;
+        strscpy(__entry->cmd, cmd, VLED_TRACE_CMD_LEN);
+        __entry->cmd[strcspn(__entry->cmd, "\n")] = '\0';
+    ),
+
+    TP_printk("vled%u src=%s cmd=\"%s\" error=%d",
+              __entry->index, vled_trace_source(__entry->source),
+              __entry->cmd, __entry->error)
+);
+
+#endif /* _VLED_TRACE_H */
+
+// Заголовок лежит рядом с драйвером, а не в include/trace/events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE vled_trace
+#include <trace/define_trace.h>